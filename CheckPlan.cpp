@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CheckPlan.h"
+
+#include <algorithm>
+
+#include "CompatibilityMatrix.h"
+#include "MapValueIterator.h"
+
+namespace android {
+namespace vintf {
+namespace details {
+
+CompiledMatrixHal::CompiledMatrixHal(const MatrixHal& hal) : mHal(&hal) {
+    for (const auto& intf : iterateValues(hal.interfaces)) {
+        intf.forEachInstance([&](const auto& interface, const auto& instance, bool isRegex) {
+            if (!isRegex) {
+                mInstances.emplace_back(interface, instance);
+                return true;
+            }
+            auto regex = std::make_unique<Regex>();
+            if (!regex->compile(instance)) {
+                mRegexesValid = false;
+                return false;
+            }
+            mRegexes.emplace_back(interface, std::move(regex));
+            return true;
+        });
+        if (!mRegexesValid) break;
+    }
+}
+
+// providedVersions is sorted, so the smallest version >= vr.minVer() decides whether any
+// provided version supports vr.
+static bool IsSupportedBy(const VersionRange& vr, const std::set<Version>& providedVersions) {
+    auto it = providedVersions.lower_bound(vr.minVer());
+    return it != providedVersions.end() && vr.supportedBy(*it);
+}
+
+bool CompiledMatrixHal::isCompatible(const FqInstanceIndex& providedInstances,
+                                     const std::set<Version>& providedVersions) const {
+    // <version>'s are related by OR.
+    return std::any_of(mHal->versionRanges.begin(), mHal->versionRanges.end(),
+                       [&](const VersionRange& vr) {
+                           return isCompatible(vr, providedInstances, providedVersions);
+                       });
+}
+
+bool CompiledMatrixHal::isCompatible(const VersionRange& vr,
+                                     const FqInstanceIndex& providedInstances,
+                                     const std::set<Version>& providedVersions) const {
+    if (!mRegexesValid) return false;
+
+    // Exact instances are looked up directly; regex patterns are only matched against
+    // instances of the same major version and interface.
+    bool hasAnyInstance = !mInstances.empty() || !mRegexes.empty();
+    for (const auto& [interface, instance] : mInstances) {
+        if (!providedInstances.contains(vr.majorVer, vr.minMinor, interface, instance)) {
+            return false;
+        }
+    }
+    for (const auto& [interface, regex] : mRegexes) {
+        if (!providedInstances.anyInstanceOf(vr.majorVer, vr.minMinor, interface,
+                                             [&regex = regex](std::string_view provided) {
+                                                 return regex->matches(std::string(provided));
+                                             })) {
+            return false;
+        }
+    }
+
+    if (hasAnyInstance) {
+        return true;
+    }
+
+    // In some cases (e.g. tests and native HALs), compatibility matrix doesn't specify
+    // any instances. Check versions only.
+    return IsSupportedBy(vr, providedVersions);
+}
+
+bool CompiledMatrixHal::isVersionSupported(const std::set<Version>& providedVersions) const {
+    return std::any_of(
+        mHal->versionRanges.begin(), mHal->versionRanges.end(),
+        [&](const VersionRange& vr) { return IsSupportedBy(vr, providedVersions); });
+}
+
+}  // namespace details
+
+CheckPlan::CheckPlan(const CompatibilityMatrix& mat) : mMatrix(&mat) {}
+
+const CheckPlan::RequiredHals& CheckPlan::getRequiredHals() const {
+    std::call_once(mRequiredHalsOnce, [this] {
+        // mMatrix->getHals() is sorted by name.
+        for (const MatrixHal& matrixHal : mMatrix->getHals()) {
+            if (matrixHal.optional) {
+                continue;
+            }
+            if (mRequiredHals.empty() || mRequiredHals.back().first != matrixHal.name) {
+                mRequiredHals.emplace_back(matrixHal.name,
+                                           std::vector<details::CompiledMatrixHal>{});
+            }
+            mRequiredHals.back().second.emplace_back(matrixHal);
+        }
+    });
+    return mRequiredHals;
+}
+
+const std::vector<details::CompiledMatrixHal>* CheckPlan::getRequiredHals(
+    const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mRequiredHalsByNameMutex);
+    auto it = mRequiredHalsByName.find(name);
+    if (it == mRequiredHalsByName.end()) {
+        std::vector<details::CompiledMatrixHal> requiredHals;
+        for (const MatrixHal* matrixHal : mMatrix->getHals(name)) {
+            if (!matrixHal->optional) requiredHals.emplace_back(*matrixHal);
+        }
+        it = mRequiredHalsByName.emplace(name, std::move(requiredHals)).first;
+    }
+    return it->second.empty() ? nullptr : &it->second;
+}
+
+const std::map<Version, CheckPlan::SameVersionKernels>& CheckPlan::getSameVersionKernels()
+    const {
+    std::call_once(mKernelsOnce, [this] {
+        for (const MatrixKernel& matrixKernel : mMatrix->framework.mKernels) {
+            mKernels[matrixKernel.minLts().dropMinor()].kernels.push_back(&matrixKernel);
+        }
+        for (auto& [version, sameVersionKernels] : mKernels) {
+            sameVersionKernels.byLevel = KernelInfo::GroupByLevel(sameVersionKernels.kernels);
+        }
+    });
+    return mKernels;
+}
+
+const details::MatrixKernelsByLevel& CheckPlan::getKernels(const Version& kernelVersion) const {
+    static const details::MatrixKernelsByLevel kEmpty;
+    const auto& kernels = getSameVersionKernels();
+    auto it = kernels.find(kernelVersion);
+    return it == kernels.end() ? kEmpty : it->second.byLevel;
+}
+
+const details::KernelConfigIndex* CheckPlan::getKernelConfigIndex(
+    const Version& kernelVersion) const {
+    const auto& kernels = getSameVersionKernels();
+    auto it = kernels.find(kernelVersion);
+    if (it == kernels.end()) return nullptr;
+    // A device only runs one kernel version, so indexes of the other versions are not built.
+    const SameVersionKernels& entry = it->second;
+    std::call_once(entry.configIndexOnce,
+                   [&entry] { entry.configIndex.emplace(entry.kernels); });
+    return &*entry.configIndex;
+}
+
+}  // namespace vintf
+}  // namespace android
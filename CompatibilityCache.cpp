@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompatibilityCache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/macros.h>
+#include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
+
+#include "parse_string.h"
+
+namespace android {
+namespace vintf {
+namespace details {
+
+namespace {
+
+constexpr char kCacheHeader[] = "vintf-compatibility-cache-1";
+constexpr char kObjectCacheHeader[] = "vintf-object-cache-1";
+
+constexpr char kFetchPrefix[] = "fetch ";
+constexpr char kListPrefix[] = "list ";
+constexpr char kStatPrefix[] = "stat ";
+constexpr char kPropertyPrefix[] = "property ";
+
+// Fields are written as <length>:<data>, so that they may contain any characters.
+void writeField(std::ostream& os, const std::string& field) {
+    os << field.size() << ":" << field << ",";
+}
+
+bool readField(const std::string& content, size_t* pos, std::string* out) {
+    size_t colon = content.find(':', *pos);
+    if (colon == std::string::npos) return false;
+    size_t size;
+    if (!android::base::ParseUint(content.substr(*pos, colon - *pos), &size)) return false;
+    size_t begin = colon + 1;
+    if (size > content.size() - begin || begin + size >= content.size() ||
+        content[begin + size] != ',') {
+        return false;
+    }
+    *out = content.substr(begin, size);
+    *pos = begin + size + 1;
+    return true;
+}
+
+std::string fingerprintResult(status_t status, const std::string& content) {
+    return std::to_string(status) + "/" + (status == OK ? fingerprint(content) : "");
+}
+
+std::string fingerprintResult(status_t status, const std::vector<std::string>& files) {
+    std::string joined;
+    for (const auto& file : files) {
+        joined += file + "\n";
+    }
+    return fingerprintResult(status, joined);
+}
+
+std::string fingerprintResult(status_t status, const FileStat& stat) {
+    return std::to_string(status) + "/" +
+           (status == OK ? std::to_string(stat.size) + "-" + std::to_string(stat.mtimeNs) + "-" +
+                               std::to_string(stat.inode)
+                         : "");
+}
+
+bool startsWith(const std::string& s, const char* prefix, std::string* rest) {
+    size_t len = strlen(prefix);
+    if (s.compare(0, len, prefix) != 0) return false;
+    *rest = s.substr(len);
+    return true;
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Drop the content fingerprint of files and directories whose stat is recorded, so that
+// they are validated without reading them.
+InputFingerprints preferStat(const InputFingerprints& inputs) {
+    InputFingerprints ret;
+    for (const auto& [input, value] : inputs) {
+        std::string path;
+        if ((startsWith(input, kFetchPrefix, &path) || startsWith(input, kListPrefix, &path)) &&
+            inputs.count(kStatPrefix + path) > 0) {
+            continue;
+        }
+        ret.emplace(input, value);
+    }
+    return ret;
+}
+
+// Write to a temporary file and rename, so that readers never see a partial file. The
+// temporary file is unique, so that concurrent writers never publish each other's partial
+// files; the last rename wins.
+void writeFileAtomically(const std::string& path, const std::string& content) {
+    std::string tmpPath = path + ".XXXXXX";
+    android::base::unique_fd fd(mkstemp(tmpPath.data()));
+    if (!fd.ok()) {
+        PLOG(WARNING) << "Cannot create temporary file for cache " << path;
+        return;
+    }
+    if (!android::base::WriteStringToFd(content, fd) || fchmod(fd, 0644) != 0 ||
+        rename(tmpPath.c_str(), path.c_str()) != 0) {
+        PLOG(WARNING) << "Cannot write cache " << path;
+        unlink(tmpPath.c_str());
+    }
+}
+
+}  // namespace
+
+std::string fingerprint(const std::string& data) {
+    // 64-bit FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+    return std::to_string(data.size()) + "-" + buf;
+}
+
+// Recorded before the file is read, so that a change in between is detected next time.
+void RecordingFileSystem::recordStat(const std::string& path) const {
+    FileStat stat;
+    status_t status = mImpl->getStat(path, &stat, nullptr);
+    if (status == INVALID_OPERATION) return;
+    std::string value = fingerprintResult(status, stat);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mInputs[kStatPrefix + path] = std::move(value);
+}
+
+status_t RecordingFileSystem::fetch(const std::string& path, std::string* fetched,
+                                    std::string* error) const {
+    recordStat(path);
+    status_t status = mImpl->fetch(path, fetched, error);
+    std::string value = fingerprintResult(status, *fetched);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mInputs[kFetchPrefix + path] = std::move(value);
+    return status;
+}
+
+status_t RecordingFileSystem::listFiles(const std::string& path, std::vector<std::string>* out,
+                                        std::string* error) const {
+    recordStat(path);
+    std::vector<std::string> files;
+    status_t status = mImpl->listFiles(path, &files, error);
+    out->insert(out->end(), files.begin(), files.end());
+    std::string value = fingerprintResult(status, files);
+    std::lock_guard<std::mutex> lock(mMutex);
+    mInputs[kListPrefix + path] = std::move(value);
+    return status;
+}
+
+status_t RecordingFileSystem::getStat(const std::string& path, FileStat* out,
+                                      std::string* error) const {
+    return mImpl->getStat(path, out, error);
+}
+
+void RecordingFileSystem::getInputs(InputFingerprints* out) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    out->insert(mInputs.begin(), mInputs.end());
+}
+
+void RecordingFileSystem::addInputs(const InputFingerprints& inputs) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& [input, value] : inputs) {
+        if (startsWith(input, kFetchPrefix) || startsWith(input, kListPrefix) ||
+            startsWith(input, kStatPrefix)) {
+            mInputs[input] = value;
+        }
+    }
+}
+
+bool RecordingFileSystem::verify(const std::string& input,
+                                 const std::string& expectedFingerprint) const {
+    std::string path;
+    std::string error;
+    if (startsWith(input, kFetchPrefix, &path)) {
+        std::string fetched;
+        status_t status = mImpl->fetch(path, &fetched, &error);
+        return fingerprintResult(status, fetched) == expectedFingerprint;
+    }
+    if (startsWith(input, kListPrefix, &path)) {
+        std::vector<std::string> files;
+        status_t status = mImpl->listFiles(path, &files, &error);
+        return fingerprintResult(status, files) == expectedFingerprint;
+    }
+    if (startsWith(input, kStatPrefix, &path)) {
+        FileStat stat;
+        status_t status = mImpl->getStat(path, &stat, &error);
+        return fingerprintResult(status, stat) == expectedFingerprint;
+    }
+    return false;
+}
+
+std::string RecordingPropertyFetcher::getProperty(const std::string& key,
+                                                  const std::string& defaultValue) const {
+    record(key);
+    return mImpl->getProperty(key, defaultValue);
+}
+
+uint64_t RecordingPropertyFetcher::getUintProperty(const std::string& key, uint64_t defaultValue,
+                                                   uint64_t max) const {
+    record(key);
+    return mImpl->getUintProperty(key, defaultValue, max);
+}
+
+bool RecordingPropertyFetcher::getBoolProperty(const std::string& key, bool defaultValue) const {
+    record(key);
+    return mImpl->getBoolProperty(key, defaultValue);
+}
+
+// Typed getters are derived from the raw value, so only the raw value is recorded.
+void RecordingPropertyFetcher::record(const std::string& key) const {
+    std::string value = fingerprint(mImpl->getProperty(key, ""));
+    std::lock_guard<std::mutex> lock(mMutex);
+    mInputs[kPropertyPrefix + key] = std::move(value);
+}
+
+void RecordingPropertyFetcher::getInputs(InputFingerprints* out) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    out->insert(mInputs.begin(), mInputs.end());
+}
+
+void RecordingPropertyFetcher::addInputs(const InputFingerprints& inputs) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& [input, value] : inputs) {
+        if (startsWith(input, kPropertyPrefix)) {
+            mInputs[input] = value;
+        }
+    }
+}
+
+bool RecordingPropertyFetcher::verify(const std::string& input,
+                                      const std::string& expectedFingerprint) const {
+    std::string key;
+    if (!startsWith(input, kPropertyPrefix, &key)) {
+        return false;
+    }
+    return fingerprint(mImpl->getProperty(key, "")) == expectedFingerprint;
+}
+
+bool CompatibilityCache::lookup(const std::string& key, int32_t* status,
+                                std::string* error) const {
+    std::string content;
+    if (!android::base::ReadFileToString(mPath, &content)) {
+        return false;
+    }
+    size_t pos = 0;
+    std::string header, storedKey, statusString, storedError, countString;
+    if (!readField(content, &pos, &header) || header != kCacheHeader ||
+        !readField(content, &pos, &storedKey) || storedKey != key ||
+        !readField(content, &pos, &statusString) || !readField(content, &pos, &storedError) ||
+        !readField(content, &pos, &countString)) {
+        return false;
+    }
+    int32_t storedStatus;
+    size_t count;
+    if (!android::base::ParseInt(statusString, &storedStatus) ||
+        !android::base::ParseUint(countString, &count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::string input, expected;
+        if (!readField(content, &pos, &input) || !readField(content, &pos, &expected)) {
+            return false;
+        }
+        if (!mFileSystem->verify(input, expected) && !mPropertyFetcher->verify(input, expected)) {
+            LOG(INFO) << "Compatibility cache " << mPath << " is stale: " << input << " changed";
+            return false;
+        }
+    }
+    if (pos != content.size()) {
+        return false;
+    }
+    *status = storedStatus;
+    if (error) *error = storedError;
+    return true;
+}
+
+void CompatibilityCache::store(const std::string& key, int32_t status,
+                               const std::string& error) const {
+    InputFingerprints inputs;
+    mFileSystem->getInputs(&inputs);
+    mPropertyFetcher->getInputs(&inputs);
+    inputs = preferStat(inputs);
+
+    std::ostringstream oss;
+    writeField(oss, kCacheHeader);
+    writeField(oss, key);
+    writeField(oss, std::to_string(status));
+    writeField(oss, error);
+    writeField(oss, std::to_string(inputs.size()));
+    for (const auto& [input, value] : inputs) {
+        writeField(oss, input);
+        writeField(oss, value);
+    }
+
+    writeFileAtomically(mPath, oss.str());
+}
+
+bool ObjectCache::read(Entries* entries) const {
+    std::string content;
+    if (!android::base::ReadFileToString(mPath, &content)) {
+        return false;
+    }
+    size_t pos = 0;
+    std::string header, countString;
+    size_t count;
+    if (!readField(content, &pos, &header) || header != kObjectCacheHeader ||
+        !readField(content, &pos, &countString) ||
+        !android::base::ParseUint(countString, &count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::string name, inputCountString;
+        Entry entry;
+        size_t inputCount;
+        if (!readField(content, &pos, &name) || !readField(content, &pos, &entry.xml) ||
+            !readField(content, &pos, &inputCountString) ||
+            !android::base::ParseUint(inputCountString, &inputCount)) {
+            return false;
+        }
+        for (size_t j = 0; j < inputCount; ++j) {
+            std::string input, value;
+            if (!readField(content, &pos, &input) || !readField(content, &pos, &value)) {
+                return false;
+            }
+            entry.inputs.emplace(std::move(input), std::move(value));
+        }
+        entries->emplace(std::move(name), std::move(entry));
+    }
+    return pos == content.size();
+}
+
+bool ObjectCache::lookup(const std::string& name, std::string* xml) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entries entries;
+    if (!read(&entries)) {
+        return false;
+    }
+    auto it = entries.find(name);
+    if (it == entries.end()) {
+        return false;
+    }
+    const Entry& entry = it->second;
+    for (const auto& [input, expected] : entry.inputs) {
+        if (!mFileSystem->verify(input, expected) && !mPropertyFetcher->verify(input, expected)) {
+            LOG(INFO) << "Object cache " << mPath << " is stale for " << name << ": " << input
+                      << " changed";
+            return false;
+        }
+    }
+    mFileSystem->addInputs(entry.inputs);
+    mPropertyFetcher->addInputs(entry.inputs);
+    *xml = entry.xml;
+    return true;
+}
+
+void ObjectCache::store(const std::string& name, const std::string& xml) const {
+    InputFingerprints inputs;
+    mFileSystem->getInputs(&inputs);
+    mPropertyFetcher->getInputs(&inputs);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Other processes may store entries at the same time. The cache file itself is replaced
+    // by rename, so the lock is held on a separate file with a stable inode.
+    std::string lockPath = mPath + ".lock";
+    android::base::unique_fd lockFd(
+        TEMP_FAILURE_RETRY(open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)));
+    if (!lockFd.ok() || TEMP_FAILURE_RETRY(flock(lockFd, LOCK_EX)) != 0) {
+        PLOG(WARNING) << "Cannot lock " << lockPath << "; not storing " << name;
+        return;
+    }
+    Entries entries;
+    if (!read(&entries)) {
+        entries.clear();
+    }
+    entries[name] = Entry{xml, preferStat(inputs)};
+
+    std::ostringstream oss;
+    writeField(oss, kObjectCacheHeader);
+    writeField(oss, std::to_string(entries.size()));
+    for (const auto& [entryName, entry] : entries) {
+        writeField(oss, entryName);
+        writeField(oss, entry.xml);
+        writeField(oss, std::to_string(entry.inputs.size()));
+        for (const auto& [input, value] : entry.inputs) {
+            writeField(oss, input);
+            writeField(oss, value);
+        }
+    }
+    writeFileAtomically(mPath, oss.str());
+}
+
+}  // namespace details
+}  // namespace vintf
+}  // namespace android
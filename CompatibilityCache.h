@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_COMPATIBILITY_CACHE_H
+#define ANDROID_VINTF_COMPATIBILITY_CACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vintf/FileSystem.h>
+#include <vintf/PropertyFetcher.h>
+
+namespace android {
+namespace vintf {
+namespace details {
+
+// Return a fingerprint of data. This is not a cryptographic hash; it is only used to
+// detect changes of inputs between runs.
+std::string fingerprint(const std::string& data);
+
+// Inputs consumed by a VintfObject, from an input name (e.g. "fetch /vendor/etc/vintf/x.xml")
+// to the fingerprint of its value.
+using InputFingerprints = std::map<std::string, std::string>;
+
+// A FileSystem that forwards to another FileSystem and records the fingerprint of the result
+// of each call. If the FileSystem supports getStat, the stat of each path is recorded too.
+class RecordingFileSystem : public FileSystem {
+   public:
+    RecordingFileSystem(std::unique_ptr<FileSystem>&& impl) : mImpl(std::move(impl)) {}
+    status_t fetch(const std::string& path, std::string* fetched,
+                   std::string* error) const override;
+    status_t listFiles(const std::string& path, std::vector<std::string>* out,
+                       std::string* error) const override;
+    status_t getStat(const std::string& path, FileStat* out, std::string* error) const override;
+
+    // Append the recorded inputs to out.
+    void getInputs(InputFingerprints* out) const;
+    // Record the inputs recognized by verify() from inputs, as if they were read by this
+    // object.
+    void addInputs(const InputFingerprints& inputs) const;
+    // Return true if the input was recorded by this object and its value still has the
+    // given fingerprint. Does not record anything.
+    bool verify(const std::string& input, const std::string& expectedFingerprint) const;
+
+   private:
+    void recordStat(const std::string& path) const;
+
+    std::unique_ptr<FileSystem> mImpl;
+    mutable std::mutex mMutex;
+    mutable InputFingerprints mInputs;
+};
+
+// A PropertyFetcher that forwards to another PropertyFetcher and records the fingerprint of
+// the raw value of each property that is read.
+class RecordingPropertyFetcher : public PropertyFetcher {
+   public:
+    RecordingPropertyFetcher(std::unique_ptr<PropertyFetcher>&& impl) : mImpl(std::move(impl)) {}
+    std::string getProperty(const std::string& key,
+                            const std::string& defaultValue = "") const override;
+    uint64_t getUintProperty(const std::string& key, uint64_t defaultValue,
+                             uint64_t max = UINT64_MAX) const override;
+    bool getBoolProperty(const std::string& key, bool defaultValue) const override;
+
+    void getInputs(InputFingerprints* out) const;
+    void addInputs(const InputFingerprints& inputs) const;
+    bool verify(const std::string& input, const std::string& expectedFingerprint) const;
+
+   private:
+    void record(const std::string& key) const;
+
+    std::unique_ptr<PropertyFetcher> mImpl;
+    mutable std::mutex mMutex;
+    mutable InputFingerprints mInputs;
+};
+
+// An on-disk cache of the result of VintfObject::checkCompatibility. An entry is keyed by
+// the check flags and the RuntimeInfo identity, and stores the fingerprints of all files and
+// properties consumed to compute the result. The entry is only used if all of these inputs
+// are unchanged. Like ObjectCache, files are identified by their stat where the FileSystem
+// supports it.
+class CompatibilityCache {
+   public:
+    // fileSystem and propertyFetcher are the dependencies of the VintfObject, and must
+    // outlive this object.
+    CompatibilityCache(const std::string& path, const RecordingFileSystem* fileSystem,
+                       const RecordingPropertyFetcher* propertyFetcher)
+        : mPath(path), mFileSystem(fileSystem), mPropertyFetcher(propertyFetcher) {}
+
+    // Return true and set status and error if the stored entry matches key and all its
+    // inputs are unchanged.
+    bool lookup(const std::string& key, int32_t* status, std::string* error) const;
+
+    // Store the result, together with all inputs recorded so far. Failure to write the
+    // file is logged and otherwise ignored.
+    void store(const std::string& key, int32_t status, const std::string& error) const;
+
+   private:
+    std::string mPath;
+    const RecordingFileSystem* mFileSystem;
+    const RecordingPropertyFetcher* mPropertyFetcher;
+};
+
+// An on-disk cache of the objects assembled by a VintfObject (e.g. the device manifest merged
+// from all its fragments), so that other processes do not fetch, parse and merge all files
+// again. Each entry stores the object as XML, together with the fingerprints of all files and
+// properties consumed so far. Files are identified by their stat (size, modification time and
+// inode) where the FileSystem supports it, so an entry is validated without reading them.
+class ObjectCache {
+   public:
+    // fileSystem and propertyFetcher are the dependencies of the VintfObject, and must
+    // outlive this object.
+    ObjectCache(const std::string& path, const RecordingFileSystem* fileSystem,
+                const RecordingPropertyFetcher* propertyFetcher)
+        : mPath(path), mFileSystem(fileSystem), mPropertyFetcher(propertyFetcher) {}
+
+    // Return true and set xml if the stored entry with the given name exists and all its
+    // inputs are unchanged. The inputs of the entry are then recorded as if they were read,
+    // so that entries and results stored later depend on them.
+    bool lookup(const std::string& name, std::string* xml) const;
+
+    // Store the entry, together with all inputs recorded so far, replacing the stored entry
+    // with the same name and keeping other entries, including those stored concurrently by
+    // other processes. Failure to write the file is logged and otherwise ignored.
+    void store(const std::string& name, const std::string& xml) const;
+
+   private:
+    struct Entry {
+        std::string xml;
+        InputFingerprints inputs;
+    };
+    using Entries = std::map<std::string, Entry>;
+    bool read(Entries* entries) const;
+
+    std::string mPath;
+    const RecordingFileSystem* mFileSystem;
+    const RecordingPropertyFetcher* mPropertyFetcher;
+    // Serializes read-modify-write of the file within this process. Across processes, it
+    // is serialized by flock() on <path>.lock.
+    mutable std::mutex mMutex;
+};
+
+}  // namespace details
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_COMPATIBILITY_CACHE_H
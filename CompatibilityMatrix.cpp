@@ -17,6 +17,7 @@
 #include "CompatibilityMatrix.h"
 
 #include <iostream>
+#include <set>
 #include <utility>
 
 #include <android-base/logging.h>
@@ -137,39 +138,34 @@ std::string CompatibilityMatrix::getXmlSchemaPath(const std::string& xmlFileName
 //   to "this") that contains only interface/instance.
 MatrixHal* CompatibilityMatrix::splitInstance(MatrixHal* existingHal, const std::string& interface,
                                               const std::string& instanceOrPattern, bool isRegex) {
-    bool found = false;
-    bool foundOthers = false;
-    existingHal->forEachInstance([&](const auto& matrixInstance) {
-        bool interfaceMatch = matrixInstance.interface() == interface;
-        bool instanceMatch = false;
-        if (matrixInstance.isRegex() && isRegex) {
-            instanceMatch = (matrixInstance.regexPattern() == instanceOrPattern);
-        } else if (!matrixInstance.isRegex() && !isRegex) {
-            instanceMatch = (matrixInstance.exactInstance() == instanceOrPattern);
-        }
-
-        bool match = interfaceMatch && instanceMatch;
-
-        found |= match;
-        foundOthers |= (!match);
-
-        return !found || !foundOthers;
-    });
-
-    if (!found) {
+    // A HAL without <version> has no instances.
+    if (existingHal->versionRanges.empty()) {
+        return nullptr;
+    }
+    // Look up interface/instance with the interfaces map and instance sets of existingHal
+    // instead of traversing all of its instances.
+    auto intfIt = existingHal->interfaces.find(interface);
+    if (intfIt == existingHal->interfaces.end() ||
+        !intfIt->second.hasInstance(instanceOrPattern, isRegex)) {
         return nullptr;
     }
 
+    bool foundOthers = intfIt->second.instancesCount() > 1;
+    for (auto it = existingHal->interfaces.begin();
+         !foundOthers && it != existingHal->interfaces.end(); ++it) {
+        foundOthers = it != intfIt && it->second.hasAnyInstance();
+    }
     if (!foundOthers) {
         return existingHal;
     }
 
     existingHal->removeInstance(interface, instanceOrPattern, isRegex);
-    MatrixHal copy = *existingHal;
-    copy.clearInstances();
-    copy.insertInstance(interface, instanceOrPattern, isRegex);
+    // Only copy the attributes of existingHal, not its interfaces.
+    MatrixHal split{existingHal->format, existingHal->name, existingHal->versionRanges,
+                    existingHal->optional, {}};
+    split.insertInstance(interface, instanceOrPattern, isRegex);
 
-    return addInternal(std::move(copy));
+    return addInternal(std::move(split));
 }
 
 // Add all package@other_version::interface/instance as an optional instance.
@@ -372,6 +368,104 @@ std::unique_ptr<CompatibilityMatrix> CompatibilityMatrix::combine(
     return baseMatrix;
 }
 
+std::unique_ptr<CompatibilityMatrix> CompatibilityMatrix::combineWithHigherLevels(
+    Level deviceLevel, std::vector<Named<CompatibilityMatrix>>* matrices,
+    const CompatibilityMatrix* higher, std::string* error) {
+    auto baseMatrix = combine(deviceLevel, matrices, error);
+    if (baseMatrix == nullptr || higher == nullptr) {
+        return baseMatrix;
+    }
+    // addAllAsOptional moves out of its input, so add a copy. The copy shares the instance
+    // sets of higher until they are modified.
+    Named<CompatibilityMatrix> higherCopy{"<levels above " + to_string(deviceLevel) + ">",
+                                          *higher};
+    if (!baseMatrix->addAllAsOptional(&higherCopy, error)) {
+        if (error) {
+            *error = "Conflict when merging higher levels: " + *error;
+        }
+        return nullptr;
+    }
+    return baseMatrix;
+}
+
+std::map<Level, std::unique_ptr<CompatibilityMatrix>> CompatibilityMatrix::combineAllLevels(
+    const std::vector<Named<CompatibilityMatrix>>& matrices,
+    std::map<Level, std::string>* errors) {
+    std::string typeError;
+    std::set<Level> deviceLevels;
+    bool hasUnspecifiedLevel = false;
+    for (const auto& e : matrices) {
+        if (e.object.type() != SchemaType::FRAMEWORK) {
+            if (typeError.empty()) {
+                typeError = "File \"" + e.name + "\" is not a framework compatibility matrix.";
+            }
+            continue;
+        }
+        if (e.object.level() == Level::UNSPECIFIED) {
+            hasUnspecifiedLevel = true;
+        } else {
+            deviceLevels.insert(e.object.level());
+        }
+    }
+
+    std::map<Level, std::unique_ptr<CompatibilityMatrix>> ret;
+    // The matrices of all levels above the current one, combined without the matrices of
+    // unspecified level, which only apply to the current level. Null at the highest level.
+    const CompatibilityMatrix* higher = nullptr;
+    std::unique_ptr<CompatibilityMatrix> higherStorage;
+    // Whether higher is valid. If a level cannot be combined on its own, the levels below
+    // may still be (e.g. conflicting <sepolicy> of a higher level is ignored), but only
+    // by combining all of their matrices from scratch.
+    bool incremental = true;
+    for (auto it = deviceLevels.rbegin(); it != deviceLevels.rend(); ++it) {
+        Level deviceLevel = *it;
+        std::string error = typeError;
+        std::unique_ptr<CompatibilityMatrix> combined;
+        if (typeError.empty() && incremental) {
+            std::vector<Named<CompatibilityMatrix>> matricesOfLevel;
+            for (const auto& e : matrices) {
+                if (e.object.level() == deviceLevel) matricesOfLevel.push_back(e);
+            }
+            std::vector<Named<CompatibilityMatrix>> matricesForLevel;
+            if (hasUnspecifiedLevel) {
+                matricesForLevel = matricesOfLevel;
+                for (const auto& e : matrices) {
+                    if (e.object.level() == Level::UNSPECIFIED) matricesForLevel.push_back(e);
+                }
+            }
+            auto combinedOfLevel =
+                combineWithHigherLevels(deviceLevel, &matricesOfLevel, higher, &error);
+            if (combinedOfLevel == nullptr) {
+                incremental = false;
+            } else if (!hasUnspecifiedLevel) {
+                higher = combinedOfLevel.get();
+                combined = std::move(combinedOfLevel);
+            } else {
+                combined = combineWithHigherLevels(deviceLevel, &matricesForLevel, higher, &error);
+                higherStorage = std::move(combinedOfLevel);
+                higher = higherStorage.get();
+            }
+        }
+        if (typeError.empty() && !incremental) {
+            error.clear();
+            // Matrices below deviceLevel are ignored by combine(), so do not copy them.
+            std::vector<Named<CompatibilityMatrix>> matricesForLevel;
+            for (const auto& e : matrices) {
+                if (e.object.level() == Level::UNSPECIFIED || e.object.level() >= deviceLevel) {
+                    matricesForLevel.push_back(e);
+                }
+            }
+            combined = combine(deviceLevel, &matricesForLevel, &error);
+        }
+        if (combined == nullptr && errors) {
+            (*errors)[deviceLevel] =
+                "Cannot combine matrices for level " + to_string(deviceLevel) + ": " + error;
+        }
+        ret.emplace(deviceLevel, std::move(combined));
+    }
+    return ret;
+}
+
 std::unique_ptr<CompatibilityMatrix> CompatibilityMatrix::combineDeviceMatrices(
     std::vector<Named<CompatibilityMatrix>>* matrices, std::string* error) {
     auto baseMatrix = std::make_unique<CompatibilityMatrix>();
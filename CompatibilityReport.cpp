@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CompatibilityReport.h"
+
+#include <set>
+#include <sstream>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include "CompatibilityMatrix.h"
+#include "HalManifest.h"
+#include "RuntimeInfo.h"
+#include "parse_string.h"
+
+namespace android {
+namespace vintf {
+
+// indent = 2, {"foo"} => "foo"
+// indent = 2, {"foo", "bar"} => "\n  foo\n  bar";
+template <typename Container>
+static void multilineIndent(std::ostream& os, size_t indent, const Container& lines) {
+    if (lines.size() == 1) {
+        os << *lines.begin();
+        return;
+    }
+    for (const auto& line : lines) {
+        os << "\n";
+        for (size_t i = 0; i < indent; ++i) os << " ";
+        os << line;
+    }
+}
+
+// static
+CompatibilityIssue CompatibilityIssue::ForKernel(const KernelInfo& kernel, Level kernelLevel,
+                                                 const KernelConfig* unmetConfig) {
+    CompatibilityIssue issue{unmetConfig != nullptr ? Type::KERNEL_CONFIG : Type::KERNEL_VERSION};
+    issue.kernel = &kernel;
+    issue.kernelLevel = kernelLevel;
+    issue.kernelConfig = unmetConfig;
+    if (unmetConfig != nullptr) {
+        auto it = kernel.configs().find(unmetConfig->first);
+        if (it != kernel.configs().end()) issue.kernelConfigValue = &it->second;
+    }
+    return issue;
+}
+
+std::string CompatibilityReport::toString() const {
+    if (mIssues.empty()) return "";
+
+    if (!mIssues.front().isHal()) {
+        return toString(mIssues.front());
+    }
+
+    std::string ret = "HALs incompatible.";
+    if (mMatrix->level() != Level::UNSPECIFIED)
+        ret += " Matrix level = " + to_string(mMatrix->level()) + ".";
+    if (mManifest->level() != Level::UNSPECIFIED)
+        ret += " Manifest level = " + to_string(mManifest->level()) + ".";
+    ret += " The following requirements are not met:\n";
+    for (const auto& issue : mIssues) {
+        ret += toString(issue) + "\n";
+    }
+    return ret;
+}
+
+std::string CompatibilityReport::toString(const CompatibilityIssue& issue) const {
+    switch (issue.type) {
+        case CompatibilityIssue::Type::WRONG_TYPE: {
+            if (mRuntimeInfo != nullptr) {
+                return "Should not check runtime info against " + to_string(mMatrix->mType) +
+                       " compatibility matrix.";
+            }
+            return "Wrong type; checking " + to_string(mManifest->mType) + " manifest against " +
+                   to_string(mMatrix->mType) + " compatibility matrix";
+        }
+        case CompatibilityIssue::Type::HAL_MISSING:
+        case CompatibilityIssue::Type::HAL_VERSION:
+        case CompatibilityIssue::Type::HAL_INSTANCE: {
+            std::ostringstream oss;
+            oss << issue.matrixHal->name << ":\n    required: ";
+            multilineIndent(oss, 8, expandInstances(*issue.matrixHal));
+            oss << "\n    provided: ";
+            std::set<std::string> simpleManifestInstances;
+            std::set<Version> versions;
+            for (const ManifestHal* manifestHal : issue.manifestHals) {
+                manifestHal->forEachInstance([&](const auto& manifestInstance) {
+                    simpleManifestInstances.insert(manifestInstance.getSimpleFqInstance());
+                    return true;
+                });
+                versions.insert(manifestHal->versions.begin(), manifestHal->versions.end());
+            }
+            if (simpleManifestInstances.empty()) {
+                multilineIndent(oss, 8, versions);
+            } else {
+                multilineIndent(oss, 8, simpleManifestInstances);
+            }
+            return oss.str();
+        }
+        case CompatibilityIssue::Type::VENDOR_NDK_VERSION: {
+            std::string ret = "Vndk version " + mMatrix->device.mVendorNdk.version() +
+                              " is not supported. " +
+                              "Supported versions in framework manifest are:";
+            for (const auto& vndk : mManifest->framework.mVendorNdks) {
+                ret += " " + vndk.version();
+            }
+            return ret;
+        }
+        case CompatibilityIssue::Type::VENDOR_NDK_LIBRARIES: {
+            std::string ret = "Vndk libs incompatible for version " +
+                              mMatrix->device.mVendorNdk.version() +
+                              ". These libs are not in framework manifest:";
+            for (const auto& name : issue.missing) {
+                ret += " " + name;
+            }
+            return ret;
+        }
+        case CompatibilityIssue::Type::SYSTEM_SDK: {
+            return "The following System SDK versions are required by device "
+                   "compatibility matrix but not supported by the framework manifest: [" +
+                   base::Join(issue.missing, ", ") + "]. Supported versions are: [" +
+                   base::Join(mManifest->framework.mSystemSdk.versions(), ", ") + "].";
+        }
+        case CompatibilityIssue::Type::SEPOLICY: {
+            return "Sepolicy version " + to_string(mManifest->device.mSepolicyVersion) +
+                   " doesn't satisify the requirements.";
+        }
+        case CompatibilityIssue::Type::KERNEL_SEPOLICY: {
+            return "kernelSepolicyVersion = " + to_string(mRuntimeInfo->kernelSepolicyVersion()) +
+                   " but required >= " +
+                   to_string(mMatrix->framework.mSepolicy.kernelSepolicyVersion());
+        }
+        case CompatibilityIssue::Type::KERNEL_VERSION:
+        case CompatibilityIssue::Type::KERNEL_CONFIG: {
+            // Re-run the check to get the detailed message of the kernel checks.
+            std::string error;
+            issue.kernel->getMatchedKernelRequirements(mMatrix->framework.mKernels,
+                                                       issue.kernelLevel, &error);
+            return error;
+        }
+        case CompatibilityIssue::Type::AVB: {
+            std::stringstream ss;
+            ss << "AVB version " << mRuntimeInfo->bootAvbVersion()
+               << " does not match framework matrix " << mMatrix->framework.mAvbMetaVersion;
+            return ss.str();
+        }
+        case CompatibilityIssue::Type::VBMETA_AVB: {
+            std::stringstream ss;
+            ss << "Vbmeta version " << mRuntimeInfo->bootVbmetaAvbVersion()
+               << " does not match framework matrix " << mMatrix->framework.mAvbMetaVersion;
+            return ss.str();
+        }
+    }
+    LOG(FATAL) << "Unknown compatibility issue type " << static_cast<int>(issue.type);
+    return "";
+}
+
+} // namespace vintf
+} // namespace android
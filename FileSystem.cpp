@@ -18,6 +18,7 @@
 #include <vintf/FileSystem.h>
 
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include <android-base/file.h>
 
@@ -63,6 +64,27 @@ status_t FileSystemImpl::listFiles(const std::string& path, std::vector<std::str
     return -saved_errno;
 }
 
+status_t FileSystemImpl::getStat(const std::string& path, FileStat* out,
+                                 std::string* error) const {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        int saved_errno = errno;
+        if (error) {
+            *error = "Cannot stat " + path + ": " + strerror(saved_errno);
+        }
+        return saved_errno == 0 ? UNKNOWN_ERROR : -saved_errno;
+    }
+    out->size = st.st_size;
+#ifdef __APPLE__
+    const timespec& mtime = st.st_mtimespec;
+#else
+    const timespec& mtime = st.st_mtim;
+#endif
+    out->mtimeNs = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    out->inode = st.st_ino;
+    return OK;
+}
+
 status_t FileSystemNoOp::fetch(const std::string&, std::string*, std::string*) const {
     return NAME_NOT_FOUND;
 }
@@ -89,6 +111,11 @@ status_t FileSystemUnderPath::listFiles(const std::string& path, std::vector<std
     return mImpl.listFiles(mRootDir + path, out, error);
 }
 
+status_t FileSystemUnderPath::getStat(const std::string& path, FileStat* out,
+                                      std::string* error) const {
+    return mImpl.getStat(mRootDir + path, out, error);
+}
+
 const std::string& FileSystemUnderPath::getRootDir() const {
     return mRootDir;
 }
@@ -14,28 +14,130 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <array>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "HalInterface.h"
 
 namespace android {
 namespace vintf {
 
+namespace {
+
+// Pool of all live instance sets, keyed by a hash of the content. Entries are weak so
+// that a set is freed when the last HalInterface that refers to it is gone. Expired entries
+// are purged lazily by intern(), so releasing a set never takes a lock.
+struct InstanceSetPool {
+    std::mutex mutex;
+    std::unordered_multimap<size_t, std::weak_ptr<const std::set<std::string>>> sets;
+    // When the pool grows to this size, all expired entries are purged.
+    size_t purgeThreshold = kMinPurgeThreshold;
+
+    static constexpr size_t kMinPurgeThreshold = 1024;
+};
+
+// Sets are sharded by hash so that threads parsing different files rarely contend.
+constexpr size_t kNumInstanceSetPools = 16;
+
+InstanceSetPool& GetInstanceSetPool(size_t hash) {
+    // Never destroyed, so that sets released during static destruction are still valid.
+    static auto* pools = new std::array<InstanceSetPool, kNumInstanceSetPools>();
+    return (*pools)[hash % kNumInstanceSetPools];
+}
+
+size_t HashInstanceSet(const std::set<std::string>& instances) {
+    size_t hash = instances.size();
+    for (const auto& instance : instances) {
+        hash = hash * 31 + std::hash<std::string>{}(instance);
+    }
+    return hash;
+}
+
+void PurgeExpired(InstanceSetPool* pool) {
+    for (auto it = pool->sets.begin(); it != pool->sets.end();) {
+        it = it->second.expired() ? pool->sets.erase(it) : std::next(it);
+    }
+    pool->purgeThreshold =
+        std::max(InstanceSetPool::kMinPurgeThreshold, pool->sets.size() * 2);
+}
+
+}  // namespace
+
+HalInterface::InstanceSet HalInterface::intern(std::set<std::string>&& instances) {
+    // Most interfaces have no regexes, and default-constructed ones have no instances.
+    static const auto* kEmpty = new InstanceSet(std::make_shared<const std::set<std::string>>());
+    if (instances.empty()) return *kEmpty;
+
+    size_t hash = HashInstanceSet(instances);
+    auto& pool = GetInstanceSetPool(hash);
+    // Sets that are locked but do not match are released after the pool is unlocked.
+    std::vector<InstanceSet> mismatches;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    auto range = pool.sets.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        if (auto existing = it->second.lock(); existing != nullptr) {
+            if (*existing == instances) return existing;
+            mismatches.push_back(std::move(existing));
+            ++it;
+        } else {
+            it = pool.sets.erase(it);
+        }
+    }
+    // Not make_shared, so that the memory is freed with the last reference rather than
+    // when the expired entry is purged.
+    InstanceSet ret(new std::set<std::string>(std::move(instances)));
+    pool.sets.emplace(hash, ret);
+    if (pool.sets.size() >= pool.purgeThreshold) PurgeExpired(&pool);
+    return ret;
+}
+
+void HalInterface::setInstances(std::set<std::string>&& instances,
+                                std::set<std::string>&& regexes) {
+    mInstances = intern(std::move(instances));
+    mRegexes = intern(std::move(regexes));
+    mInstancesPrivate = mRegexesPrivate = false;
+}
+
+std::set<std::string>* HalInterface::mutableInstances(bool isRegex) {
+    auto& set = isRegex ? mRegexes : mInstances;
+    bool& isPrivate = isRegex ? mRegexesPrivate : mInstancesPrivate;
+    // A private set is never handed out by intern(), so if this object holds the only
+    // reference, nothing else can observe the modification.
+    if (!isPrivate || set.use_count() != 1) {
+        set = InstanceSet(new std::set<std::string>(*set));
+        isPrivate = true;
+    }
+    // Private sets are allocated as non-const objects above.
+    return const_cast<std::set<std::string>*>(set.get());
+}
+
+HalInterface::HalInterface() : mInstances(intern({})), mRegexes(mInstances) {}
+
+HalInterface::HalInterface(std::string&& name, std::set<std::string>&& instances)
+    : mName(std::move(name)), mInstances(intern(std::move(instances))), mRegexes(intern({})) {}
+
+HalInterface::HalInterface(const std::string& name, const std::set<std::string>& instances)
+    : HalInterface(std::string(name), std::set<std::string>(instances)) {}
+
 bool operator==(const HalInterface& lft, const HalInterface& rgt) {
     if (lft.mName != rgt.mName) return false;
-    if (lft.mInstances != rgt.mInstances) return false;
+    if (lft.mInstances != rgt.mInstances && *lft.mInstances != *rgt.mInstances) return false;
     return true;
 }
 
 bool HalInterface::forEachInstance(
     const std::function<bool(const std::string&, const std::string&, bool isRegex)>& func) const {
-    for (const auto& instance : mInstances) {
+    for (const auto& instance : *mInstances) {
         if (!func(mName, instance, false /* isRegex */)) {
             return false;
         }
     }
-    for (const auto& instance : mRegexes) {
+    for (const auto& instance : *mRegexes) {
         if (!func(mName, instance, true /* isRegex */)) {
             return false;
         }
@@ -52,20 +154,25 @@ bool HalInterface::hasAnyInstance() const {
     return found;
 }
 
+bool HalInterface::hasInstance(const std::string& instanceOrPattern, bool isRegex) const {
+    const auto& set = isRegex ? mRegexes : mInstances;
+    return set->find(instanceOrPattern) != set->end();
+}
+
 bool HalInterface::insertInstance(const std::string& instanceOrPattern, bool isRegex) {
-    if (isRegex) {
-        return mRegexes.insert(instanceOrPattern).second;
-    } else {
-        return mInstances.insert(instanceOrPattern).second;
+    if (hasInstance(instanceOrPattern, isRegex)) {
+        return false;
     }
+    mutableInstances(isRegex)->insert(instanceOrPattern);
+    return true;
 }
 
 bool HalInterface::removeInstance(const std::string& instanceOrPattern, bool isRegex) {
-    if (isRegex) {
-        return mRegexes.erase(instanceOrPattern) > 0;
-    } else {
-        return mInstances.erase(instanceOrPattern) > 0;
+    if (!hasInstance(instanceOrPattern, isRegex)) {
+        return false;
     }
+    mutableInstances(isRegex)->erase(instanceOrPattern);
+    return true;
 }
 
 } // namespace vintf
@@ -21,12 +21,15 @@
 
 #include <dirent.h>
 
+#include <algorithm>
 #include <mutex>
 #include <set>
 
 #include <android-base/strings.h>
 
+#include "CheckPlan.h"
 #include "CompatibilityMatrix.h"
+#include "HidlInheritanceGraph.h"
 #include "constants-private.h"
 #include "constants.h"
 #include "parse_string.h"
@@ -48,17 +51,21 @@ bool HalManifest::shouldAdd(const ManifestHal& hal) const {
     if (hal.isOverride()) {
         return true;
     }
+    if (hal.versions.empty()) {
+        return true;
+    }
+    // hal.isValid() ensures that hal.versions has distinct major versions, so only
+    // existing HALs with the same name need to be checked.
+    std::set<size_t> newMajorVersions;
+    for (const auto& v : hal.versions) {
+        newMajorVersions.insert(v.majorVer);
+    }
     auto existingHals = mHals.equal_range(hal.name);
-    std::set<size_t> existingMajorVersions;
     for (auto it = existingHals.first; it != existingHals.second; ++it) {
         for (const auto& v : it->second.versions) {
-            // Assume integrity on existingHals, so no check on emplace().second
-            existingMajorVersions.insert(v.majorVer);
-        }
-    }
-    for (const auto& v : hal.versions) {
-        if (!existingMajorVersions.emplace(v.majorVer).second /* no insertion */) {
-            return false;
+            if (newMajorVersions.count(v.majorVer) > 0) {
+                return false;
+            }
         }
     }
     return true;
@@ -77,17 +84,19 @@ static void removeIf(List& list, Predicate predicate) {
 }
 
 void HalManifest::removeHals(const std::string& name, size_t majorVer) {
-    removeIf(mHals, [&name, majorVer](auto& existingHalPair) {
-        auto& existingHal = existingHalPair.second;
-        if (existingHal.name != name) {
-            return false;
-        }
-        auto& existingVersions = existingHal.versions;
+    // Only HALs with the given name are affected; do not walk all of mHals.
+    auto range = mHals.equal_range(name);
+    for (auto it = range.first; it != range.second;) {
+        auto& existingVersions = it->second.versions;
         removeIf(existingVersions, [majorVer](const auto& existingVersion) {
             return existingVersion.majorVer == majorVer;
         });
-        return existingVersions.empty();
-    });
+        if (existingVersions.empty()) {
+            it = mHals.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 bool HalManifest::add(ManifestHal&& halToAdd) {
@@ -175,70 +184,71 @@ bool HalManifest::forEachInstanceOfVersion(
     return true;
 }
 
-// indent = 2, {"foo"} => "foo"
-// indent = 2, {"foo", "bar"} => "\n  foo\n  bar";
-template <typename Container>
-void multilineIndent(std::ostream& os, size_t indent, const Container& lines) {
-    if (lines.size() == 1) {
-        os << *lines.begin();
-        return;
-    }
-    for (const auto& line : lines) {
-        os << "\n";
-        for (size_t i = 0; i < indent; ++i) os << " ";
-        os << line;
-    }
-}
-
 // For each hal in mat, there must be a hal in manifest that supports this.
-std::vector<std::string> HalManifest::checkIncompatibleHals(const CompatibilityMatrix& mat) const {
-    std::vector<std::string> ret;
-    for (const MatrixHal &matrixHal : mat.getHals()) {
-        if (matrixHal.optional) {
-            continue;
-        }
-
-        std::set<FqInstance> manifestInstances;
-        std::set<std::string> simpleManifestInstances;
+bool HalManifest::checkIncompatibleHals(const CheckPlan& plan, CompatibilityReport* report,
+                                        const std::set<std::string>* halNames) const {
+    bool ret = true;
+    // Check all required HALs with the same name. Return false to stop.
+    auto checkHals = [&](const std::vector<details::CompiledMatrixHal>& requiredHals) {
+        const std::string& name = requiredHals.front().hal().name;
+
+        // Index the provided instances once, then probe it for each required instance.
+        // The index points into the ManifestHals, which outlive this call.
+        details::FqInstanceIndex manifestInstances;
         std::set<Version> versions;
-        for (const ManifestHal* manifestHal : getHals(matrixHal.name)) {
-            manifestHal->forEachInstance([&](const auto& manifestInstance) {
-                manifestInstances.insert(manifestInstance.getFqInstance());
-                simpleManifestInstances.insert(manifestInstance.getSimpleFqInstance());
+        auto manifestHals = getHals(name);
+        for (const ManifestHal* manifestHal : manifestHals) {
+            manifestHal->forEachInstanceView([&](const auto& view) {
+                manifestInstances.insert(view);
                 return true;
             });
             manifestHal->appendAllVersions(&versions);
         }
 
-        if (!matrixHal.isCompatible(manifestInstances, versions)) {
-            std::ostringstream oss;
-            oss << matrixHal.name << ":\n    required: ";
-            multilineIndent(oss, 8, android::vintf::expandInstances(matrixHal));
-            oss << "\n    provided: ";
-            if (manifestInstances.empty()) {
-                multilineIndent(oss, 8, versions);
-            } else {
-                multilineIndent(oss, 8, simpleManifestInstances);
+        for (const auto& requiredHal : requiredHals) {
+            if (requiredHal.isCompatible(manifestInstances, versions)) {
+                continue;
             }
+            ret = false;
+            if (report == nullptr) return false;
+            // Only format the instances when the report is rendered.
+            CompatibilityIssue issue{CompatibilityIssue::Type::HAL_MISSING};
+            if (!manifestHals.empty()) {
+                issue.type = requiredHal.isVersionSupported(versions)
+                                 ? CompatibilityIssue::Type::HAL_INSTANCE
+                                 : CompatibilityIssue::Type::HAL_VERSION;
+            }
+            issue.matrixHal = &requiredHal.hal();
+            issue.manifestHals.assign(manifestHals.begin(), manifestHals.end());
+            report->mIssues.push_back(std::move(issue));
+        }
+        return true;
+    };
 
-            ret.insert(ret.end(), oss.str());
+    if (halNames == nullptr) {
+        for (const auto& [name, requiredHals] : plan.getRequiredHals()) {
+            if (!checkHals(requiredHals)) break;
         }
+        return ret;
+    }
+    // Names are visited in the same order as the matrix.
+    for (const std::string& name : *halNames) {
+        const auto* requiredHals = plan.getRequiredHals(name);
+        if (requiredHals != nullptr && !checkHals(*requiredHals)) break;
     }
     return ret;
 }
 
 std::set<std::string> HalManifest::checkUnusedHals(
     const CompatibilityMatrix& mat, const std::vector<HidlInterfaceMetadata>& hidlMetadata) const {
-    std::multimap<std::string, std::string> childrenMap;
-    for (const auto& child : hidlMetadata) {
-        for (const auto& parent : child.inherited) {
-            childrenMap.emplace(parent, child.name);
-        }
-    }
+    return checkUnusedHals(mat, HidlInheritanceGraph(hidlMetadata));
+}
 
+std::set<std::string> HalManifest::checkUnusedHals(const CompatibilityMatrix& mat,
+                                                   const HidlInheritanceGraph& inheritance) const {
     std::set<std::string> ret;
 
-    forEachInstance([&ret, &mat, &childrenMap](const auto& manifestInstance) {
+    forEachInstance([&ret, &mat, &inheritance](const auto& manifestInstance) {
         if (mat.matchInstance(manifestInstance.format(), manifestInstance.package(),
                               manifestInstance.version(), manifestInstance.interface(),
                               manifestInstance.instance())) {
@@ -249,14 +259,15 @@ std::set<std::string> HalManifest::checkUnusedHals(
         // matrix may contain only 2.0 if 1.0 is considered deprecated. Hence, if manifestInstance
         // is 1.0, check all its children in the matrix too.
         // If there is at least one match, do not consider it unused.
-        if (manifestInstance.format() == HalFormat::HIDL) {
-            auto range =
-                childrenMap.equal_range(manifestInstance.getFqInstance().getFqName().string());
-            for (auto it = range.first; it != range.second; ++it) {
-                FQName fqName;
-                CHECK(fqName.setTo(it->second));
-                if (mat.matchInstance(manifestInstance.format(), fqName.package(),
-                                      fqName.getVersion(), fqName.name(),
+        auto node = manifestInstance.format() == HalFormat::HIDL
+                        ? inheritance.find(manifestInstance.getFqInstance().getFqName().string())
+                        : std::nullopt;
+        if (node.has_value()) {
+            for (auto child : inheritance.children(*node)) {
+                const FQName* fqName = inheritance.fqName(child);
+                CHECK(fqName != nullptr) << "Cannot parse " << inheritance.name(child);
+                if (mat.matchInstance(manifestInstance.format(), fqName->package(),
+                                      fqName->getVersion(), fqName->name(),
                                       manifestInstance.instance())) {
                     return true;
                 }
@@ -273,7 +284,7 @@ std::set<std::string> HalManifest::checkUnusedHals(
 
 static bool checkVendorNdkCompatibility(const VendorNdk& matVendorNdk,
                                         const std::vector<VendorNdk>& manifestVendorNdk,
-                                        std::string* error) {
+                                        std::vector<CompatibilityIssue>* issues) {
     // For pre-P vendor images, device compatibility matrix does not specify <vendor-ndk>
     // tag. Ignore the check for these devices.
     if (matVendorNdk.version().empty()) {
@@ -289,12 +300,10 @@ static bool checkVendorNdkCompatibility(const VendorNdk& matVendorNdk,
                             vndk.libraries().begin(), vndk.libraries().end(),
                             std::inserter(diff, diff.begin()));
         if (!diff.empty()) {
-            if (error != nullptr) {
-                *error = "Vndk libs incompatible for version " + matVendorNdk.version() +
-                         ". These libs are not in framework manifest:";
-                for (const auto& name : diff) {
-                    *error += " " + name;
-                }
+            if (issues != nullptr) {
+                CompatibilityIssue issue{CompatibilityIssue::Type::VENDOR_NDK_LIBRARIES};
+                issue.missing = std::move(diff);
+                issues->push_back(std::move(issue));
             }
             return false;
         }
@@ -302,26 +311,21 @@ static bool checkVendorNdkCompatibility(const VendorNdk& matVendorNdk,
     }
 
     // no match is found.
-    if (error != nullptr) {
-        *error = "Vndk version " + matVendorNdk.version() + " is not supported. " +
-                 "Supported versions in framework manifest are:";
-        for (const auto& vndk : manifestVendorNdk) {
-            *error += " " + vndk.version();
-        }
+    if (issues != nullptr) {
+        issues->push_back({CompatibilityIssue::Type::VENDOR_NDK_VERSION});
     }
     return false;
 }
 
 static bool checkSystemSdkCompatibility(const SystemSdk& matSystemSdk,
-                                        const SystemSdk& manifestSystemSdk, std::string* error) {
+                                        const SystemSdk& manifestSystemSdk,
+                                        std::vector<CompatibilityIssue>* issues) {
     SystemSdk notSupported = matSystemSdk.removeVersions(manifestSystemSdk);
     if (!notSupported.empty()) {
-        if (error) {
-            *error =
-                "The following System SDK versions are required by device "
-                "compatibility matrix but not supported by the framework manifest: [" +
-                base::Join(notSupported.versions(), ", ") + "]. Supported versions are: [" +
-                base::Join(manifestSystemSdk.versions(), ", ") + "].";
+        if (issues != nullptr) {
+            CompatibilityIssue issue{CompatibilityIssue::Type::SYSTEM_SDK};
+            issue.missing.assign(notSupported.versions().begin(), notSupported.versions().end());
+            issues->push_back(std::move(issue));
         }
         return false;
     }
@@ -330,34 +334,60 @@ static bool checkSystemSdkCompatibility(const SystemSdk& matSystemSdk,
 
 bool HalManifest::checkCompatibility(const CompatibilityMatrix& mat, std::string* error,
                                      CheckFlags::Type flags) const {
+    // The plan only preprocesses the parts of the matrix that this check reaches, e.g. no
+    // kernel requirements are grouped if the check stops at the HALs.
+    return checkCompatibility(CheckPlan(mat), error, flags);
+}
+
+bool HalManifest::getCompatibilityReport(const CompatibilityMatrix& mat,
+                                         CompatibilityReport* report,
+                                         CheckFlags::Type flags) const {
+    return getCompatibilityReport(CheckPlan(mat), report, flags);
+}
+
+bool HalManifest::checkCompatibility(const CheckPlan& plan, std::string* error,
+                                     CheckFlags::Type flags) const {
+    if (error == nullptr) {
+        return getCompatibilityReport(plan, nullptr /* report */, flags, nullptr /* halNames */);
+    }
+    CompatibilityReport report;
+    if (getCompatibilityReport(plan, &report, flags)) {
+        return true;
+    }
+    *error = report.toString();
+    return false;
+}
+
+bool HalManifest::getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                         CheckFlags::Type flags) const {
+    return getCompatibilityReport(plan, report, flags, nullptr /* halNames */);
+}
+
+bool HalManifest::getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                         CheckFlags::Type flags,
+                                         const std::set<std::string>* halNames) const {
+    const CompatibilityMatrix& mat = plan.matrix();
+    if (report != nullptr) {
+        report->mManifest = this;
+        report->mMatrix = &mat;
+    }
     if (mType == mat.mType) {
-        if (error != nullptr) {
-            *error = "Wrong type; checking " + to_string(mType) + " manifest against "
-                    + to_string(mat.mType) + " compatibility matrix";
+        if (report != nullptr) {
+            report->mIssues.push_back({CompatibilityIssue::Type::WRONG_TYPE});
         }
         return false;
     }
-    auto incompatibleHals = checkIncompatibleHals(mat);
-    if (!incompatibleHals.empty()) {
-        if (error != nullptr) {
-            *error = "HALs incompatible.";
-            if (mat.level() != Level::UNSPECIFIED)
-                *error += " Matrix level = " + to_string(mat.level()) + ".";
-            if (level() != Level::UNSPECIFIED)
-                *error += " Manifest level = " + to_string(level()) + ".";
-            *error += " The following requirements are not met:\n";
-            for (const auto& e : incompatibleHals) {
-                *error += e + "\n";
-            }
-        }
+    if (!checkIncompatibleHals(plan, report, halNames)) {
         return false;
     }
     if (mType == SchemaType::FRAMEWORK) {
-        if (!checkVendorNdkCompatibility(mat.device.mVendorNdk, framework.mVendorNdks, error)) {
+        if (!checkVendorNdkCompatibility(mat.device.mVendorNdk, framework.mVendorNdks,
+                                         report != nullptr ? &report->mIssues : nullptr)) {
             return false;
         }
 
-        if (!checkSystemSdkCompatibility(mat.device.mSystemSdk, framework.mSystemSdk, error)) {
+        if (!checkSystemSdkCompatibility(mat.device.mSystemSdk, framework.mSystemSdk,
+                                         report != nullptr ? &report->mIssues : nullptr)) {
             return false;
         }
     } else if (mType == SchemaType::DEVICE) {
@@ -369,24 +399,123 @@ bool HalManifest::checkCompatibility(const CompatibilityMatrix& mat, std::string
             }
         }
         if (!sepolicyMatch) {
-            if (error != nullptr) {
-                *error = "Sepolicy version " + to_string(device.mSepolicyVersion)
-                        + " doesn't satisify the requirements.";
+            if (report != nullptr) {
+                report->mIssues.push_back({CompatibilityIssue::Type::SEPOLICY});
             }
             return false;
         }
 
-        if (flags.isKernelEnabled() && shouldCheckKernelCompatibility() &&
-            kernel()
-                ->getMatchedKernelRequirements(mat.framework.mKernels, kernel()->level(), error)
-                .empty()) {
-            return false;
+        if (flags.isKernelEnabled() && shouldCheckKernelCompatibility()) {
+            const KernelConfig* unmetConfig = nullptr;
+            if (kernel()
+                    ->getMatchedKernelRequirements(
+                        plan.getKernels(kernel()->version().dropMinor()),
+                        plan.getKernelConfigIndex(kernel()->version().dropMinor()),
+                        mat.framework.mKernels, kernel()->level(), nullptr /* error */,
+                        report != nullptr ? &unmetConfig : nullptr)
+                    .empty()) {
+                if (report != nullptr) {
+                    report->mIssues.push_back(
+                        CompatibilityIssue::ForKernel(*kernel(), kernel()->level(), unmetConfig));
+                }
+                return false;
+            }
         }
     }
 
     return true;
 }
 
+// Whether hals1 and hals2, the HALs with the same name of two matrices, have the same
+// required HALs in the same order.
+static bool sameRequiredHals(std::vector<const MatrixHal*> hals1,
+                             std::vector<const MatrixHal*> hals2) {
+    auto isOptional = [](const MatrixHal* matrixHal) { return matrixHal->optional; };
+    hals1.erase(std::remove_if(hals1.begin(), hals1.end(), isOptional), hals1.end());
+    hals2.erase(std::remove_if(hals2.begin(), hals2.end(), isOptional), hals2.end());
+    return std::equal(hals1.begin(), hals1.end(), hals2.begin(), hals2.end(),
+                      [](const MatrixHal* hal1, const MatrixHal* hal2) { return *hal1 == *hal2; });
+}
+
+std::vector<LevelCompatibility> HalManifest::checkCompatibilityForAllLevels(
+    const std::vector<Named<CompatibilityMatrix>>& frameworkMatrices, std::string* error,
+    CheckFlags::Type flags) const {
+    std::map<Level, std::string> errors;
+    auto combinedMatrices = CompatibilityMatrix::combineAllLevels(frameworkMatrices, &errors);
+    if (combinedMatrices.empty()) {
+        if (error) {
+            *error = "No framework compatibility matrix declares FCM version.";
+        }
+        return {};
+    }
+
+    // Requirements other than HALs are cheap to check.
+    static const std::set<std::string> kNoHals;
+    std::vector<LevelCompatibility> ret;
+    // The last level that is combined, and the first issue of each of its incompatible HALs.
+    const CompatibilityMatrix* previous = nullptr;
+    std::map<std::string, std::string> previousHalErrors;
+    for (const auto& [level, combined] : combinedMatrices) {
+        LevelCompatibility result;
+        result.level = level;
+        const CompatibilityMatrix* matrix = combined.get();
+        if (matrix == nullptr) {
+            result.error = errors[level];
+            ret.push_back(std::move(result));
+            continue;
+        }
+
+        CheckPlan plan(*matrix);
+        CompatibilityReport report;
+        result.compatible = getCompatibilityReport(plan, &report, flags, &kNoHals);
+        if (!result.compatible &&
+            report.issues().front().type == CompatibilityIssue::Type::WRONG_TYPE) {
+            result.error = report.toString(report.issues().front());
+            ret.push_back(std::move(result));
+            continue;
+        }
+
+        // Required HALs that are the same as in the previous level are not checked again, so
+        // their requirements are not compiled either.
+        std::set<std::string> changedHals;
+        std::map<std::string, std::string> halErrors;
+        const std::string* lastName = nullptr;
+        // getHals() is sorted by name.
+        for (const MatrixHal& matrixHal : matrix->getHals()) {
+            if (matrixHal.optional || (lastName != nullptr && *lastName == matrixHal.name)) {
+                continue;
+            }
+            lastName = &matrixHal.name;
+            if (previous == nullptr || !sameRequiredHals(previous->getHals(matrixHal.name),
+                                                         matrix->getHals(matrixHal.name))) {
+                changedHals.insert(matrixHal.name);
+                continue;
+            }
+            auto it = previousHalErrors.find(matrixHal.name);
+            if (it != previousHalErrors.end()) halErrors.insert(*it);
+        }
+        CompatibilityReport halReport;
+        halReport.mManifest = this;
+        halReport.mMatrix = matrix;
+        checkIncompatibleHals(plan, &halReport, &changedHals);
+        for (const auto& issue : halReport.issues()) {
+            halErrors.emplace(issue.matrixHal->name, halReport.toString(issue));
+        }
+
+        // HALs are checked before the other requirements, in the order of their names.
+        if (!halErrors.empty()) {
+            result.compatible = false;
+            result.error = halErrors.begin()->second;
+        } else if (!result.compatible && !report.empty()) {
+            result.error = report.toString(report.issues().front());
+        }
+        ret.push_back(std::move(result));
+        previous = matrix;
+        previousHalErrors = std::move(halErrors);
+    }
+    return ret;
+}
+
 bool HalManifest::shouldCheckKernelCompatibility() const {
     return kernel().has_value() && kernel()->version() != KernelVersion{};
 }
@@ -528,10 +657,9 @@ bool HalManifest::hasAidlInstance(const std::string& package, const std::string&
 
 bool HalManifest::insertInstance(const FqInstance& fqInstance, Transport transport, Arch arch,
                                  HalFormat format, std::string* error) {
-    for (ManifestHal& hal : getHals()) {
-        if (hal.name == fqInstance.getPackage() && hal.format == format &&
-            hal.transport() == transport && hal.arch() == arch) {
-            return hal.insertInstance(fqInstance, error);
+    for (ManifestHal* hal : getHals(fqInstance.getPackage())) {
+        if (hal->format == format && hal->transport() == transport && hal->arch() == arch) {
+            return hal->insertInstance(fqInstance, error);
         }
     }
 
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HidlInheritanceGraph.h"
+
+#include <algorithm>
+#include <set>
+
+namespace android {
+namespace vintf {
+
+HidlInheritanceGraph::HidlInheritanceGraph(
+    const std::vector<HidlInterfaceMetadata>& hidlMetadata) {
+    for (const auto& child : hidlMetadata) {
+        NodeId childId = intern(child.name);
+        for (const auto& parent : child.inherited) {
+            NodeId parentId = intern(parent);
+            mChildren[parentId].push_back(childId);
+        }
+    }
+}
+
+std::vector<HidlInheritanceGraph::NodeId> HidlInheritanceGraph::descendants(NodeId node) const {
+    std::vector<NodeId> ret;
+    std::set<NodeId> visited;
+    std::vector<NodeId> stack{node};
+    while (!stack.empty()) {
+        NodeId current = stack.back();
+        stack.pop_back();
+        for (NodeId child : mChildren[current]) {
+            if (!visited.insert(child).second) continue;
+            ret.push_back(child);
+            stack.push_back(child);
+        }
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+HidlInheritanceGraph::NodeId HidlInheritanceGraph::intern(const std::string& name) {
+    auto [it, inserted] = mIds.emplace(name, mNames.size());
+    if (inserted) {
+        mNames.push_back(name);
+        FQName fqName;
+        mFqNames.push_back(fqName.setTo(name) ? std::make_optional(std::move(fqName))
+                                              : std::nullopt);
+        mChildren.emplace_back();
+    }
+    return it->second;
+}
+
+std::optional<HidlInheritanceGraph::NodeId> HidlInheritanceGraph::find(
+    const std::string& fqName) const {
+    auto it = mIds.find(fqName);
+    if (it == mIds.end()) return std::nullopt;
+    return it->second;
+}
+
+const FQName* HidlInheritanceGraph::fqName(NodeId node) const {
+    return mFqNames[node].has_value() ? &*mFqNames[node] : nullptr;
+}
+
+}  // namespace vintf
+}  // namespace android
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KernelConfigIndex.h"
+
+#include "parse_string.h"
+
+namespace android {
+namespace vintf {
+namespace details {
+
+static constexpr size_t kBitsPerWord = 64;
+
+static void setBit(KernelConfigIndex::Bits* bits, size_t id) {
+    (*bits)[id / kBitsPerWord] |= uint64_t{1} << (id % kBitsPerWord);
+}
+
+static void clearBit(KernelConfigIndex::Bits* bits, size_t id) {
+    (*bits)[id / kBitsPerWord] &= ~(uint64_t{1} << (id % kBitsPerWord));
+}
+
+KernelConfigIndex::KernelConfigIndex(const std::vector<const MatrixKernel*>& kernels) {
+    // Intern all keys first so that all bitsets have the same size.
+    for (const MatrixKernel* kernel : kernels) {
+        for (const KernelConfig& config : kernel->conditions()) getOrAddId(config.first);
+        for (const KernelConfig& config : kernel->configs()) getOrAddId(config.first);
+    }
+    for (const MatrixKernel* kernel : kernels) {
+        mRequirements.emplace(kernel,
+                              std::make_pair(compile(kernel->conditions()),
+                                             compile(kernel->configs())));
+    }
+}
+
+size_t KernelConfigIndex::getOrAddId(std::string_view key) {
+    return mIds.emplace(key, mIds.size()).first->second;
+}
+
+KernelConfigIndex::TristateBits KernelConfigIndex::emptyBits() const {
+    size_t numWords = (mIds.size() + kBitsPerWord - 1) / kBitsPerWord;
+    return TristateBits{Bits(numWords), Bits(numWords), Bits(numWords)};
+}
+
+KernelConfigIndex::Requirement KernelConfigIndex::compile(
+    const std::vector<KernelConfig>& configs) {
+    Requirement requirement{emptyBits(), {}};
+    for (const KernelConfig& config : configs) {
+        const KernelConfigTypedValue& value = config.second;
+        if (value.mType != KernelConfigType::TRISTATE) {
+            requirement.others.push_back(config);
+            continue;
+        }
+        size_t id = mIds.at(config.first);
+        switch (value.mTristateValue) {
+            case Tristate::YES:
+                setBit(&requirement.tristates.yes, id);
+                break;
+            case Tristate::MODULE:
+                setBit(&requirement.tristates.module, id);
+                break;
+            case Tristate::NO:
+                setBit(&requirement.tristates.no, id);
+                break;
+        }
+    }
+    return requirement;
+}
+
+const KernelConfigIndex::Requirement* KernelConfigIndex::conditions(
+    const MatrixKernel* kernel) const {
+    auto it = mRequirements.find(kernel);
+    return it == mRequirements.end() ? nullptr : &it->second.first;
+}
+
+const KernelConfigIndex::Requirement* KernelConfigIndex::configs(
+    const MatrixKernel* kernel) const {
+    auto it = mRequirements.find(kernel);
+    return it == mRequirements.end() ? nullptr : &it->second.second;
+}
+
+KernelConfigIndex::TristateBits KernelConfigIndex::getTristateBits(
+    const std::map<std::string, std::string>& kernelConfigs) const {
+    TristateBits bits = emptyBits();
+    // Configs that are not set are treated as "n", which matches the special case in
+    // KernelInfo::matchKernelConfigs.
+    for (auto& word : bits.no) word = ~uint64_t{0};
+    for (const auto& [key, value] : kernelConfigs) {
+        auto it = mIds.find(key);
+        if (it == mIds.end()) continue;
+        size_t id = it->second;
+        clearBit(&bits.no, id);
+        Tristate tristate;
+        if (!parse(value, &tristate)) continue;
+        switch (tristate) {
+            case Tristate::YES:
+                setBit(&bits.yes, id);
+                break;
+            case Tristate::MODULE:
+                setBit(&bits.module, id);
+                break;
+            case Tristate::NO:
+                setBit(&bits.no, id);
+                break;
+        }
+    }
+    return bits;
+}
+
+// static
+bool KernelConfigIndex::Matches(const TristateBits& required, const TristateBits& kernel) {
+    for (size_t i = 0; i < required.yes.size(); ++i) {
+        if ((required.yes[i] & ~kernel.yes[i]) | (required.module[i] & ~kernel.module[i]) |
+            (required.no[i] & ~kernel.no[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace details
+}  // namespace vintf
+}  // namespace android
@@ -70,7 +70,8 @@ bool KernelConfigTypedValue::operator==(const KernelConfigTypedValue &other) con
 bool KernelConfigTypedValue::matchValue(const std::string &s) const {
     switch(mType) {
         case KernelConfigType::STRING:
-            return ("\"" + mStringValue + "\"") == s;
+            return s.size() == mStringValue.size() + 2 && s.front() == '"' && s.back() == '"' &&
+                   s.compare(1, mStringValue.size(), mStringValue) == 0;
         case KernelConfigType::INTEGER: {
             KernelConfigIntValue iv;
             return parseKernelConfigInt(s, &iv) && iv == mIntegerValue;
@@ -15,6 +15,9 @@
  */
 #include "KernelInfo.h"
 
+#include <algorithm>
+#include <iterator>
+
 #include "parse_string.h"
 #include "parse_xml.h"
 #include "utils.h"
@@ -40,6 +43,11 @@ Level KernelInfo::level() const {
 
 bool KernelInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
                                     std::string* error) const {
+    return matchKernelConfigs(matrixConfigs, nullptr /* parsedConfigs */, error);
+}
+
+const KernelConfig* KernelInfo::findUnmetConfig(const std::vector<KernelConfig>& matrixConfigs,
+                                                ParsedConfigs* parsedConfigs) const {
     for (const KernelConfig& matrixConfig : matrixConfigs) {
         const std::string& key = matrixConfig.first;
         auto it = this->mConfigs.find(key);
@@ -48,21 +56,62 @@ bool KernelInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConfi
             if (matrixConfig.second == KernelConfigTypedValue::gMissingConfig) {
                 continue;
             }
-            if (error != nullptr) {
-                *error = "Missing config " + key;
-            }
-            return false;
+            return &matrixConfig;
         }
         const std::string& kernelValue = it->second;
-        if (!matrixConfig.second.matchValue(kernelValue)) {
-            if (error != nullptr) {
-                *error = "For config " + key + ", value = " + kernelValue + " but required " +
-                         to_string(matrixConfig.second);
+        bool matched;
+        if (parsedConfigs == nullptr) {
+            matched = matrixConfig.second.matchValue(kernelValue);
+        } else {
+            auto [parsedIt, inserted] = parsedConfigs->emplace(&kernelValue, std::nullopt);
+            if (inserted) {
+                KernelConfigTypedValue parsed;
+                if (parseKernelConfigDeviceValue(kernelValue, &parsed)) {
+                    parsedIt->second = std::move(parsed);
+                }
             }
+            matched = parsedIt->second.has_value() && *parsedIt->second == matrixConfig.second;
+        }
+        if (!matched) {
+            return &matrixConfig;
+        }
+    }
+    return nullptr;
+}
+
+bool KernelInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
+                                    ParsedConfigs* parsedConfigs, std::string* error) const {
+    const KernelConfig* unmetConfig = findUnmetConfig(matrixConfigs, parsedConfigs);
+    if (unmetConfig == nullptr) {
+        return true;
+    }
+    if (error != nullptr) {
+        const std::string& key = unmetConfig->first;
+        auto it = mConfigs.find(key);
+        if (it == mConfigs.end()) {
+            *error = "Missing config " + key;
+        } else {
+            *error = "For config " + key + ", value = " + it->second + " but required " +
+                     to_string(unmetConfig->second);
+        }
+    }
+    return false;
+}
+
+bool KernelInfo::matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
+                                    const details::KernelConfigIndex::Requirement* requirement,
+                                    MatchState* state, std::string* error) const {
+    if (requirement != nullptr) {
+        if (details::KernelConfigIndex::Matches(requirement->tristates, state->tristateBits) &&
+            matchKernelConfigs(requirement->others, &state->parsedConfigs, nullptr)) {
+            return true;
+        }
+        if (error == nullptr) {
             return false;
         }
+        // Match one by one to report the first unmet requirement in the order of the matrix.
     }
-    return true;
+    return matchKernelConfigs(matrixConfigs, &state->parsedConfigs, error);
 }
 
 bool KernelInfo::matchKernelVersion(const KernelVersion& minLts) const {
@@ -70,42 +119,68 @@ bool KernelInfo::matchKernelVersion(const KernelVersion& minLts) const {
 }
 
 std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
-    const std::vector<MatrixKernel>& kernels, Level kernelLevel, std::string* error) const {
-    std::map<Level, std::vector<const MatrixKernel*>> kernelsForLevel;
+    const std::vector<MatrixKernel>& kernels, Level kernelLevel, std::string* error,
+    const KernelConfig** unmetConfig) const {
+    // Filter out kernels with different x.y.
+    std::vector<const MatrixKernel*> sameVersionKernels;
     for (const MatrixKernel& matrixKernel : kernels) {
-        const auto& minLts = matrixKernel.minLts();
-        auto matrixKernelLevel = matrixKernel.getSourceMatrixLevel();
-
-        // Filter out kernels with different x.y.
-        if (mVersion.dropMinor() != minLts.dropMinor()) {
-            continue;
+        if (mVersion.dropMinor() == matrixKernel.minLts().dropMinor()) {
+            sameVersionKernels.push_back(&matrixKernel);
         }
+    }
+    return getMatchedKernelRequirements(GroupByLevel(sameVersionKernels),
+                                        nullptr /* configIndex */, kernels, kernelLevel, error,
+                                        unmetConfig);
+}
 
-        // Check matrix kernel level
+// static
+details::MatrixKernelsByLevel KernelInfo::GroupByLevel(
+    const std::vector<const MatrixKernel*>& kernels) {
+    std::map<Level, std::vector<const MatrixKernel*>> kernelsForLevel;
+    for (const MatrixKernel* matrixKernel : kernels) {
+        kernelsForLevel[matrixKernel->getSourceMatrixLevel()].push_back(matrixKernel);
+    }
+    return details::MatrixKernelsByLevel(std::make_move_iterator(kernelsForLevel.begin()),
+                                         std::make_move_iterator(kernelsForLevel.end()));
+}
 
-        // Use legacy behavior when kernel FCM version is not specified. Blindly add all of them
-        // here. The correct one (with smallest matrixKernelLevel) will be picked later.
-        if (kernelLevel == Level::UNSPECIFIED) {
-            kernelsForLevel[matrixKernelLevel].push_back(&matrixKernel);
-            continue;
-        }
+std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
+    const details::MatrixKernelsByLevel& sameVersionKernels,
+    const details::KernelConfigIndex* configIndex, const std::vector<MatrixKernel>& kernels,
+    Level kernelLevel, std::string* error, const KernelConfig** unmetConfig) const {
+    // Kernel config values are parsed at most once, even if they are checked against
+    // requirements of multiple levels.
+    MatchState state;
+    state.findUnmetConfig = unmetConfig != nullptr;
+    if (unmetConfig != nullptr) *unmetConfig = nullptr;
+    auto setUnmetConfig = [&] {
+        if (unmetConfig != nullptr) *unmetConfig = state.unmetConfig;
+    };
+    if (configIndex != nullptr) {
+        state.configIndex = configIndex;
+        state.tristateBits = configIndex->getTristateBits(mConfigs);
+    }
+
+    // Check matrix kernel level
 
-        if (matrixKernelLevel == Level::UNSPECIFIED) {
+    // Use legacy behavior when kernel FCM version is not specified. Consider all of them
+    // here. The correct one (with smallest matrixKernelLevel) will be picked later.
+    // Otherwise, skip levels < kernel level. sameVersionKernels is sorted by level, and
+    // Level::UNSPECIFIED is the largest level.
+    auto firstForLevel = sameVersionKernels.begin();
+    if (kernelLevel != Level::UNSPECIFIED) {
+        if (!sameVersionKernels.empty() &&
+            sameVersionKernels.back().first == Level::UNSPECIFIED) {
             if (error) {
                 *error = "Seen unspecified source matrix level; this should not happen.";
             }
             return {};
         }
-
-        if (matrixKernelLevel < kernelLevel) {
-            continue;
-        }
-
-        // matrix level >= kernel level
-        kernelsForLevel[matrixKernelLevel].push_back(&matrixKernel);
+        firstForLevel = std::find_if(sameVersionKernels.begin(), sameVersionKernels.end(),
+                                     [&](const auto& entry) { return entry.first >= kernelLevel; });
     }
 
-    if (kernelsForLevel.empty()) {
+    if (firstForLevel == sameVersionKernels.end()) {
         if (error) {
             std::stringstream ss;
             ss << "No kernel entry found for kernel version " << mVersion.dropMinor()
@@ -122,8 +197,8 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
         return {};
     }
 
-    // At this point, kernelsForLevel contains kernel requirements for each level.
-    // For example, if the running kernel version is 4.14.y then kernelsForLevel contains
+    // At this point, [firstForLevel, end) contains kernel requirements for each level.
+    // For example, if the running kernel version is 4.14.y then this range contains
     // 4.14-p, 4.14-q, 4.14-r.
     // (This excludes kernels < kernel FCM version, or device FCM version if kernel FCM version is
     // empty. For example, if device level = Q and kernel level is unspecified, this list only
@@ -132,12 +207,12 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
     // Use legacy behavior when kernel FCM version is not specified. e.g. target FCM version 3 (P)
     // matches kernel 4.4-p, 4.9-p, 4.14-p, 4.19-q, etc., but not 4.9-q or 4.14-q.
     // Since we already filtered |kernels| based on kernel version, we only need to check the first
-    // item in kernelsForLevel.
+    // item in the range.
     // Note that this excludes *-r and above kernels. Devices with target FCM version >= 5 (R) must
     // state kernel FCM version explicitly in the device manifest. The value is automatically
     // inserted for devices with target FCM version >= 5 when manifest is built with assemble_vintf.
     if (kernelLevel == Level::UNSPECIFIED) {
-        auto [matrixKernelLevel, matrixKernels] = *kernelsForLevel.begin();
+        const auto& [matrixKernelLevel, matrixKernels] = *firstForLevel;
 
         // Do not allow *-r and above kernels.
         if (matrixKernelLevel != Level::UNSPECIFIED && matrixKernelLevel >= Level::R) {
@@ -153,8 +228,10 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
             return {};
         }
 
-        auto matchedMatrixKernels = getMatchedKernelVersionAndConfigs(matrixKernels, error);
+        auto matchedMatrixKernels =
+            getMatchedKernelVersionAndConfigs(matrixKernels, &state, error);
         if (matchedMatrixKernels.empty()) {
+            setUnmetConfig();
             return {};
         }
         return matchedMatrixKernels;
@@ -163,7 +240,7 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
     // Use new behavior when kernel FCM version is specified. e.g. kernel FCM version 3 (P)
     // matches kernel 4.4-p, 4.9-p, 4.14-p, 4.9-q, 4.14-q, 4.14-r etc., but not 5.4-r.
     // Note we already filtered |kernels| based on kernel version.
-    auto [firstMatrixKernelLevel, firstMatrixKernels] = *kernelsForLevel.begin();
+    Level firstMatrixKernelLevel = firstForLevel->first;
     if (firstMatrixKernelLevel == Level::UNSPECIFIED || firstMatrixKernelLevel > kernelLevel) {
         if (error) {
             *error = "Kernel FCM Version is " + to_string(kernelLevel) + " and kernel version is " +
@@ -173,13 +250,14 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
         }
         return {};
     }
-    for (auto [matrixKernelLevel, matrixKernels] : kernelsForLevel) {
+    for (auto it = firstForLevel; it != sameVersionKernels.end(); ++it) {
+        const auto& [matrixKernelLevel, matrixKernels] = *it;
         if (matrixKernelLevel == Level::UNSPECIFIED || matrixKernelLevel < kernelLevel) {
             continue;
         }
         std::string errorForLevel;
-        auto matchedMatrixKernels =
-            getMatchedKernelVersionAndConfigs(matrixKernels, &errorForLevel);
+        auto matchedMatrixKernels = getMatchedKernelVersionAndConfigs(
+            matrixKernels, &state, error != nullptr ? &errorForLevel : nullptr);
         if (matchedMatrixKernels.empty()) {
             if (error) {
                 *error += "For kernel requirements at matrix level " +
@@ -194,23 +272,38 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelRequirements(
         error->insert(0, "No compatible kernel requirement found (kernel FCM version = " +
                              to_string(kernelLevel) + ").\n");
     }
+    setUnmetConfig();
     return {};
 }
 
 std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelVersionAndConfigs(
-    const std::vector<const MatrixKernel*>& kernels, std::string* error) const {
+    const std::vector<const MatrixKernel*>& kernels, MatchState* state,
+    std::string* error) const {
+    const details::KernelConfigIndex* configIndex = state->configIndex;
     std::vector<const MatrixKernel*> result;
     bool foundMatchedKernelVersion = false;
+    // The error for unmet conditions is only reported if no fragment applies, so it is
+    // computed at the end.
+    const MatrixKernel* lastUnmetConditions = nullptr;
     for (const MatrixKernel* matrixKernel : kernels) {
         if (!matchKernelVersion(matrixKernel->minLts())) {
             continue;
         }
         foundMatchedKernelVersion = true;
         // ignore this fragment if not all conditions are met.
-        if (!matchKernelConfigs(matrixKernel->conditions(), error)) {
+        if (!matchKernelConfigs(matrixKernel->conditions(),
+                                configIndex ? configIndex->conditions(matrixKernel) : nullptr,
+                                state, nullptr /* error */)) {
+            lastUnmetConditions = matrixKernel;
             continue;
         }
-        if (!matchKernelConfigs(matrixKernel->configs(), error)) {
+        if (!matchKernelConfigs(matrixKernel->configs(),
+                                configIndex ? configIndex->configs(matrixKernel) : nullptr, state,
+                                error)) {
+            if (state->findUnmetConfig && state->unmetConfig == nullptr) {
+                state->unmetConfig =
+                    findUnmetConfig(matrixKernel->configs(), &state->parsedConfigs);
+            }
             return {};
         }
         result.push_back(matrixKernel);
@@ -234,8 +327,14 @@ std::vector<const MatrixKernel*> KernelInfo::getMatchedKernelVersionAndConfigs(
         // This should not happen because first <conditions> for each <kernel> must be
         // empty. Reject here for inconsistency.
         if (error != nullptr) {
+            error->clear();
+            matchKernelConfigs(lastUnmetConditions->conditions(), &state->parsedConfigs, error);
             error->insert(0, "Framework matches kernel version with unmet conditions.");
         }
+        if (state->findUnmetConfig && state->unmetConfig == nullptr) {
+            state->unmetConfig =
+                findUnmetConfig(lastUnmetConditions->conditions(), &state->parsedConfigs);
+        }
         return {};
     }
     if (error != nullptr) {
@@ -79,6 +79,29 @@ bool ManifestHal::forEachInstance(const std::function<bool(const ManifestInstanc
     return true;
 }
 
+bool ManifestHal::forEachInstanceView(
+    const std::function<bool(const details::FqInstanceView&)>& func) const {
+    for (const auto& v : versions) {
+        for (const auto& intf : iterateValues(interfaces)) {
+            bool cont = intf.forEachInstance([&](const auto& interface, const auto& instance,
+                                                 bool /* isRegex */) {
+                return func(details::FqInstanceView{getName(), v, interface, instance});
+            });
+            if (!cont) {
+                return false;
+            }
+        }
+    }
+
+    for (const auto& manifestInstance : mAdditionalInstances) {
+        if (!func(details::FqInstanceView::from(manifestInstance.getFqInstance()))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool ManifestHal::isDisabledHal() const {
     if (!isOverride()) return false;
     bool hasInstance = false;
@@ -91,8 +114,8 @@ bool ManifestHal::isDisabledHal() const {
 
 void ManifestHal::appendAllVersions(std::set<Version>* ret) const {
     ret->insert(versions.begin(), versions.end());
-    forEachInstance([&](const auto& e) {
-        ret->insert(e.version());
+    forEachInstanceView([&](const auto& e) {
+        ret->insert(e.version);
         return true;
     });
 }
@@ -135,13 +158,21 @@ bool ManifestHal::insertInstance(const FqInstance& e, std::string* error) {
     }
 
     size_t minorVer = e.getMinorVersion();
-    for (auto it = mAdditionalInstances.begin(); it != mAdditionalInstances.end();) {
-        if (it->version().majorVer == e.getMajorVersion() && it->interface() == e.getInterface() &&
-            it->instance() == e.getInstance()) {
-            minorVer = std::max(minorVer, it->version().minorVer);
-            it = mAdditionalInstances.erase(it);
-        } else {
-            ++it;
+    auto key = std::make_tuple(e.getMajorVersion(), e.getInterface(), e.getInstance());
+    auto indexIt = mAdditionalInstancesIndex.find(key);
+    if (indexIt != mAdditionalInstancesIndex.end()) {
+        minorVer = std::max(minorVer, indexIt->second);
+        if (!eraseAdditionalInstance(e.getMajorVersion(), indexIt->second, e.getInterface(),
+                                     e.getInstance())) {
+            // The existing instance was inserted with a different transport / format.
+            for (auto it = mAdditionalInstances.begin(); it != mAdditionalInstances.end();) {
+                if (it->version().majorVer == e.getMajorVersion() &&
+                    it->interface() == e.getInterface() && it->instance() == e.getInstance()) {
+                    it = mAdditionalInstances.erase(it);
+                } else {
+                    ++it;
+                }
+            }
         }
     }
 
@@ -157,8 +188,20 @@ bool ManifestHal::insertInstance(const FqInstance& e, std::string* error) {
     }
 
     mAdditionalInstances.emplace(std::move(toAdd), this->transportArch, this->format);
+    mAdditionalInstancesIndex[std::move(key)] = minorVer;
     return true;
 }
 
+bool ManifestHal::eraseAdditionalInstance(size_t majorVer, size_t minorVer,
+                                          const std::string& interface,
+                                          const std::string& instance) {
+    FqInstance existing;
+    if (!existing.setTo(this->getName(), majorVer, minorVer, interface, instance)) {
+        return false;
+    }
+    return mAdditionalInstances.erase(
+               ManifestInstance(std::move(existing), TransportArch{transportArch}, format)) > 0;
+}
+
 } // namespace vintf
 } // namespace android
@@ -37,10 +37,7 @@ bool MatrixHal::operator==(const MatrixHal &other) const {
 }
 
 bool MatrixHal::containsVersion(const Version& version) const {
-    for (VersionRange vRange : versionRanges) {
-        if (vRange.contains(version)) return true;
-    }
-    return false;
+    return details::anyContains(versionRanges, version);
 }
 
 bool MatrixHal::forEachInstance(const std::function<bool(const MatrixInstance&)>& func) const {
@@ -89,43 +86,6 @@ bool MatrixHal::forEachInstance(
     return true;
 }
 
-bool MatrixHal::isCompatible(const std::set<FqInstance>& providedInstances,
-                             const std::set<Version>& providedVersions) const {
-    // <version>'s are related by OR.
-    return std::any_of(versionRanges.begin(), versionRanges.end(), [&](const VersionRange& vr) {
-        return isCompatible(vr, providedInstances, providedVersions);
-    });
-}
-
-bool MatrixHal::isCompatible(const VersionRange& vr, const std::set<FqInstance>& providedInstances,
-                             const std::set<Version>& providedVersions) const {
-    bool hasAnyInstance = false;
-    bool versionUnsatisfied = false;
-
-    // Look at each interface/instance, and ensure that they are in providedInstances.
-    forEachInstance(vr, [&](const MatrixInstance& matrixInstance) {
-        hasAnyInstance = true;
-
-        versionUnsatisfied |=
-            !std::any_of(providedInstances.begin(), providedInstances.end(),
-                         [&](const FqInstance& providedInstance) {
-                             return matrixInstance.isSatisfiedBy(providedInstance);
-                         });
-
-        return !versionUnsatisfied;  // if any interface/instance is unsatisfied, break
-    });
-
-    if (hasAnyInstance) {
-        return !versionUnsatisfied;
-    }
-
-    // In some cases (e.g. tests and native HALs), compatibility matrix doesn't specify
-    // any instances. Check versions only.
-    return std::any_of(
-        providedVersions.begin(), providedVersions.end(),
-        [&](const auto& providedVersion) { return vr.supportedBy(providedVersion); });
-}
-
 void MatrixHal::setOptional(bool o) {
     this->optional = o;
 }
@@ -170,9 +130,5 @@ bool MatrixHal::removeInstance(const std::string& interface, const std::string&
     return removed;
 }
 
-void MatrixHal::clearInstances() {
-    this->interfaces.clear();
-}
-
 } // namespace vintf
 } // namespace android
@@ -28,5 +28,10 @@ status_t RuntimeInfo::fetchAllInformation(RuntimeInfo::FetchFlags /* flags */) {
     return OK;
 }
 
+status_t RuntimeInfo::fetchIdentity(RuntimeInfo::FetchFlags /* flags */,
+                                    std::string* /* identity */) const {
+    return INVALID_OPERATION;
+}
+
 } // namespace vintf
 } // namespace android
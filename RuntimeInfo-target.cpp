@@ -20,6 +20,7 @@
 
 #include "RuntimeInfo.h"
 
+#include "CompatibilityCache.h"
 #include "CompatibilityMatrix.h"
 #include "KernelConfigParser.h"
 #include "parse_string.h"
@@ -33,6 +34,7 @@
 #include <iostream>
 #include <sstream>
 
+#include <android-base/file.h>
 #include <android-base/properties.h>
 #include <selinux/selinux.h>
 #include <zlib.h>
@@ -186,5 +188,42 @@ status_t RuntimeInfo::fetchAllInformation(RuntimeInfo::FetchFlags flags) {
     return RuntimeInfoFetcher(this).fetchAllInformation(flags);
 }
 
+// /proc/cpuinfo is not used in compatibility checks, so CPU_INFO is not part of the identity.
+status_t RuntimeInfo::fetchIdentity(RuntimeInfo::FetchFlags flags, std::string* identity) const {
+    std::ostringstream oss;
+    if (flags & FetchFlag::CPU_VERSION) {
+        struct utsname buf;
+        if (uname(&buf)) {
+            return -errno;
+        }
+        oss << buf.sysname << "\n"
+            << buf.nodename << "\n"
+            << buf.release << "\n"
+            << buf.version << "\n"
+            << buf.machine << "\n";
+    }
+    if (flags & FetchFlag::CONFIG_GZ) {
+        // The compressed content changes whenever the configs do.
+        std::string config;
+        if (!android::base::ReadFileToString(PROC_CONFIG, &config)) {
+            return -errno;
+        }
+        oss << details::fingerprint(config) << "\n";
+    }
+    if (flags & FetchFlag::POLICYVERS) {
+#ifdef LIBVINTF_TARGET
+        oss << security_policyvers() << "\n";
+#else
+        oss << 0 << "\n";
+#endif
+    }
+    if (flags & FetchFlag::AVB) {
+        oss << android::base::GetProperty("ro.boot.vbmeta.avb_version", "0.0") << "\n"
+            << android::base::GetProperty("ro.boot.avb_version", "0.0") << "\n";
+    }
+    *identity = oss.str();
+    return OK;
+}
+
 } // namespace vintf
 } // namespace android
@@ -19,6 +19,7 @@
 
 #include "RuntimeInfo.h"
 
+#include "CheckPlan.h"
 #include "CompatibilityMatrix.h"
 #include "parse_string.h"
 
@@ -71,19 +72,57 @@ const Version &RuntimeInfo::bootAvbVersion() const {
 
 bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string* error,
                                      CheckFlags::Type flags) const {
+    if (error == nullptr) {
+        return getCompatibilityReport(mat, nullptr /* plan */, nullptr /* report */, flags);
+    }
+    CompatibilityReport report;
+    if (getCompatibilityReport(mat, nullptr /* plan */, &report, flags)) {
+        return true;
+    }
+    *error = report.toString();
+    return false;
+}
+
+bool RuntimeInfo::getCompatibilityReport(const CompatibilityMatrix& mat,
+                                         CompatibilityReport* report,
+                                         CheckFlags::Type flags) const {
+    return getCompatibilityReport(mat, nullptr /* plan */, report, flags);
+}
+
+bool RuntimeInfo::checkCompatibility(const CheckPlan& plan, std::string* error,
+                                     CheckFlags::Type flags) const {
+    if (error == nullptr) {
+        return getCompatibilityReport(plan.matrix(), &plan, nullptr /* report */, flags);
+    }
+    CompatibilityReport report;
+    if (getCompatibilityReport(plan.matrix(), &plan, &report, flags)) {
+        return true;
+    }
+    *error = report.toString();
+    return false;
+}
+
+bool RuntimeInfo::getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                         CheckFlags::Type flags) const {
+    return getCompatibilityReport(plan.matrix(), &plan, report, flags);
+}
+
+bool RuntimeInfo::getCompatibilityReport(const CompatibilityMatrix& mat, const CheckPlan* plan,
+                                         CompatibilityReport* report,
+                                         CheckFlags::Type flags) const {
+    auto addIssue = [report](CompatibilityIssue&& issue) {
+        if (report != nullptr) report->mIssues.push_back(std::move(issue));
+    };
+    if (report != nullptr) {
+        report->mRuntimeInfo = this;
+        report->mMatrix = &mat;
+    }
     if (mat.mType != SchemaType::FRAMEWORK) {
-        if (error != nullptr) {
-            *error = "Should not check runtime info against " + to_string(mat.mType)
-                    + " compatibility matrix.";
-        }
+        addIssue({CompatibilityIssue::Type::WRONG_TYPE});
         return false;
     }
     if (kernelSepolicyVersion() < mat.framework.mSepolicy.kernelSepolicyVersion()) {
-        if (error != nullptr) {
-            *error =
-                "kernelSepolicyVersion = " + to_string(kernelSepolicyVersion()) +
-                " but required >= " + to_string(mat.framework.mSepolicy.kernelSepolicyVersion());
-        }
+        addIssue({CompatibilityIssue::Type::KERNEL_SEPOLICY});
         return false;
     }
 
@@ -91,8 +130,18 @@ bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string
     // HalManifest.device.mSepolicyVersion in HalManifest::checkCompatibility.
 
     if (flags.isKernelEnabled()) {
-        if (mKernel.getMatchedKernelRequirements(mat.framework.mKernels, kernelLevel(), error)
-                .empty()) {
+        const KernelConfig* unmetConfig = nullptr;
+        const KernelConfig** unmetConfigPtr = report != nullptr ? &unmetConfig : nullptr;
+        auto matchedKernels =
+            plan != nullptr
+                ? mKernel.getMatchedKernelRequirements(
+                      plan->getKernels(mKernel.version().dropMinor()),
+                      plan->getKernelConfigIndex(mKernel.version().dropMinor()),
+                      mat.framework.mKernels, kernelLevel(), nullptr /* error */, unmetConfigPtr)
+                : mKernel.getMatchedKernelRequirements(mat.framework.mKernels, kernelLevel(),
+                                                       nullptr /* error */, unmetConfigPtr);
+        if (matchedKernels.empty()) {
+            addIssue(CompatibilityIssue::ForKernel(mKernel, kernelLevel(), unmetConfig));
             return false;
         }
     }
@@ -101,22 +150,12 @@ bool RuntimeInfo::checkCompatibility(const CompatibilityMatrix& mat, std::string
         const Version& matAvb = mat.framework.mAvbMetaVersion;
         if (mBootAvbVersion.majorVer != matAvb.majorVer ||
             mBootAvbVersion.minorVer < matAvb.minorVer) {
-            if (error != nullptr) {
-                std::stringstream ss;
-                ss << "AVB version " << mBootAvbVersion << " does not match framework matrix "
-                   << matAvb;
-                *error = ss.str();
-            }
+            addIssue({CompatibilityIssue::Type::AVB});
             return false;
         }
         if (mBootVbmetaAvbVersion.majorVer != matAvb.majorVer ||
             mBootVbmetaAvbVersion.minorVer < matAvb.minorVer) {
-            if (error != nullptr) {
-                std::stringstream ss;
-                ss << "Vbmeta version " << mBootVbmetaAvbVersion
-                   << " does not match framework matrix " << matAvb;
-                *error = ss.str();
-            }
+            addIssue({CompatibilityIssue::Type::VBMETA_AVB});
             return false;
         }
     }
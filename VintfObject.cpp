@@ -20,15 +20,20 @@
 
 #include <algorithm>
 #include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #include <android-base/logging.h>
 #include <android-base/result.h>
 #include <android-base/strings.h>
 #include <hidl/metadata.h>
 
+#include "CheckPlan.h"
+#include "CompatibilityCache.h"
 #include "CompatibilityMatrix.h"
+#include "HidlInheritanceGraph.h"
 #include "parse_string.h"
 #include "parse_xml.h"
 #include "utils.h"
@@ -47,6 +52,8 @@ static constexpr bool kIsTarget = true;
 static constexpr bool kIsTarget = false;
 #endif
 
+VintfObject::~VintfObject() = default;
+
 template <typename T, typename F>
 static std::shared_ptr<const T> Get(const char* id, LockedSharedPtr<T>* ptr, bool skipCache,
                                     const F& fetchAllInformation) {
@@ -70,6 +77,32 @@ static std::shared_ptr<const T> Get(const char* id, LockedSharedPtr<T>* ptr, boo
     return ptr->object;
 }
 
+// Same as fetch(out, error), but load the object from cache instead if it is set and up to
+// date, and store the fetched object in cache. If skipCache, the stored object is not used.
+template <typename T, typename F>
+static status_t FetchWithObjectCache(const ObjectCache* cache, const std::string& name,
+                                     bool skipCache, XmlConverter<T>& converter, T* out,
+                                     std::string* error, F&& fetch) {
+    if (cache == nullptr) {
+        return fetch(out, error);
+    }
+    std::string xml;
+    if (!skipCache && cache->lookup(name, &xml)) {
+        T cached;
+        if (converter(&cached, xml, nullptr /* error */)) {
+            LOG(INFO) << "Using cached " << name;
+            *out = std::move(cached);
+            return OK;
+        }
+    }
+    status_t status = fetch(out, error);
+    // Errors (e.g. missing files) are not cached.
+    if (status == OK) {
+        cache->store(name, converter(*out));
+    }
+    return status;
+}
+
 static std::unique_ptr<FileSystem> createDefaultFileSystem() {
     std::unique_ptr<FileSystem> fileSystem;
     if (kIsTarget) {
@@ -104,8 +137,20 @@ std::shared_ptr<const HalManifest> VintfObject::GetDeviceHalManifest(bool skipCa
 }
 
 std::shared_ptr<const HalManifest> VintfObject::getDeviceHalManifest(bool skipCache) {
-    return Get(__func__, &mDeviceManifest, skipCache,
-               std::bind(&VintfObject::fetchDeviceHalManifest, this, _1, _2));
+    auto ret = Get(__func__, &mDeviceManifest, skipCache,
+                   [this, skipCache](HalManifest* out, std::string* error) {
+                       mDeviceManifestSources.clear();
+                       return FetchWithObjectCache(
+                           mObjectCache.get(), "device manifest", skipCache,
+                           gHalManifestConverter, out, error,
+                           [this](HalManifest* out, std::string* error) {
+                               return fetchDeviceHalManifest(
+                                   out, error,
+                                   mIncrementalChecks ? &mDeviceManifestSources : nullptr);
+                           });
+                   });
+    if (skipCache) bumpGeneration();
+    return ret;
 }
 
 std::shared_ptr<const HalManifest> VintfObject::GetFrameworkHalManifest(bool skipCache) {
@@ -113,8 +158,23 @@ std::shared_ptr<const HalManifest> VintfObject::GetFrameworkHalManifest(bool ski
 }
 
 std::shared_ptr<const HalManifest> VintfObject::getFrameworkHalManifest(bool skipCache) {
-    return Get(__func__, &mFrameworkManifest, skipCache,
-               std::bind(&VintfObject::fetchFrameworkHalManifest, this, _1, _2));
+    if (mFrameworkSource != nullptr) {
+        return mFrameworkSource->getFrameworkHalManifest(skipCache);
+    }
+    auto ret = Get(__func__, &mFrameworkManifest, skipCache,
+                   [this, skipCache](HalManifest* out, std::string* error) {
+                       mFrameworkManifestSources.clear();
+                       return FetchWithObjectCache(
+                           mObjectCache.get(), "framework manifest", skipCache,
+                           gHalManifestConverter, out, error,
+                           [this](HalManifest* out, std::string* error) {
+                               return fetchFrameworkHalManifest(
+                                   out, error,
+                                   mIncrementalChecks ? &mFrameworkManifestSources : nullptr);
+                           });
+                   });
+    if (skipCache) bumpGeneration();
+    return ret;
 }
 
 std::shared_ptr<const CompatibilityMatrix> VintfObject::GetDeviceCompatibilityMatrix(bool skipCache) {
@@ -123,8 +183,15 @@ std::shared_ptr<const CompatibilityMatrix> VintfObject::GetDeviceCompatibilityMa
 
 std::shared_ptr<const CompatibilityMatrix> VintfObject::getDeviceCompatibilityMatrix(
     bool skipCache) {
-    return Get(__func__, &mDeviceMatrix, skipCache,
-               std::bind(&VintfObject::fetchDeviceMatrix, this, _1, _2));
+    auto ret = Get(__func__, &mDeviceMatrix, skipCache,
+                   [this, skipCache](CompatibilityMatrix* out, std::string* error) {
+                       return FetchWithObjectCache(
+                           mObjectCache.get(), "device matrix", skipCache,
+                           gCompatibilityMatrixConverter, out, error,
+                           std::bind(&VintfObject::fetchDeviceMatrix, this, _1, _2));
+                   });
+    if (skipCache) bumpGeneration();
+    return ret;
 }
 
 std::shared_ptr<const CompatibilityMatrix> VintfObject::GetFrameworkCompatibilityMatrix(bool skipCache) {
@@ -138,27 +205,43 @@ std::shared_ptr<const CompatibilityMatrix> VintfObject::getFrameworkCompatibilit
 
     std::unique_lock<std::mutex> _lock(mFrameworkCompatibilityMatrixMutex);
 
-    auto combined =
-        Get(__func__, &mCombinedFrameworkMatrix, skipCache,
-            std::bind(&VintfObject::getCombinedFrameworkMatrix, this, deviceManifest, _1, _2));
-    if (combined != nullptr) {
-        return combined;
-    }
-
-    return Get(__func__, &mFrameworkMatrix, skipCache,
-               std::bind(&CompatibilityMatrix::fetchAllInformation, _1, getFileSystem().get(),
-                         kSystemLegacyMatrix, _2));
+    if (skipCache) {
+        std::lock_guard<std::mutex> lock(mFrameworkMatrixLevels.mutex);
+        mFrameworkMatrixLevels.levels = nullptr;
+    }
+
+    auto ret = Get(__func__, &mCombinedFrameworkMatrix, skipCache,
+                   [this, skipCache, &deviceManifest](CompatibilityMatrix* out,
+                                                      std::string* error) {
+                       return FetchWithObjectCache(
+                           mObjectCache.get(), "framework matrix", skipCache,
+                           gCompatibilityMatrixConverter, out, error,
+                           std::bind(&VintfObject::getCombinedFrameworkMatrix, this,
+                                     deviceManifest, _1, _2));
+                   });
+    if (ret == nullptr) {
+        ret = Get(__func__, &mFrameworkMatrix, skipCache,
+                  [this, skipCache](CompatibilityMatrix* out, std::string* error) {
+                      return FetchWithObjectCache(
+                          mObjectCache.get(), "framework matrix", skipCache,
+                          gCompatibilityMatrixConverter, out, error,
+                          std::bind(&CompatibilityMatrix::fetchAllInformation, _1,
+                                    getFileSystem().get(), kSystemLegacyMatrix, _2));
+                  });
+    }
+    if (skipCache) bumpGeneration();
+    return ret;
 }
 
 status_t VintfObject::getCombinedFrameworkMatrix(
     const std::shared_ptr<const HalManifest>& deviceManifest, CompatibilityMatrix* out,
     std::string* error) {
-    std::vector<Named<CompatibilityMatrix>> matrixFragments;
+    std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>> matrixFragments;
     auto matrixFragmentsStatus = getAllFrameworkMatrixLevels(&matrixFragments, error);
     if (matrixFragmentsStatus != OK) {
         return matrixFragmentsStatus;
     }
-    if (matrixFragments.empty()) {
+    if (matrixFragments->empty()) {
         if (error && error->empty()) {
             *error = "Cannot get framework matrix for each FCM version for unknown error.";
         }
@@ -182,7 +265,7 @@ status_t VintfObject::getCombinedFrameworkMatrix(
     if (deviceLevel == Level::UNSPECIFIED) {
         // Cannot infer FCM version. Combine all matrices by assuming
         // Shipping FCM Version == min(all supported FCM Versions in the framework)
-        for (auto&& pair : matrixFragments) {
+        for (auto&& pair : *matrixFragments) {
             Level fragmentLevel = pair.object.level();
             if (fragmentLevel != Level::UNSPECIFIED && deviceLevel > fragmentLevel) {
                 deviceLevel = fragmentLevel;
@@ -200,7 +283,16 @@ status_t VintfObject::getCombinedFrameworkMatrix(
         return NAME_NOT_FOUND;
     }
 
-    auto combined = CompatibilityMatrix::combine(deviceLevel, &matrixFragments, error);
+    // combine() modifies the fragments, so it works on copies. Fragments below deviceLevel
+    // are ignored by combine(), so they are not copied.
+    std::vector<Named<CompatibilityMatrix>> fragmentsToCombine;
+    for (const auto& fragment : *matrixFragments) {
+        Level fragmentLevel = fragment.object.level();
+        if (fragmentLevel == Level::UNSPECIFIED || fragmentLevel >= deviceLevel) {
+            fragmentsToCombine.push_back(fragment);
+        }
+    }
+    auto combined = CompatibilityMatrix::combine(deviceLevel, &fragmentsToCombine, error);
     if (combined == nullptr) {
         return BAD_VALUE;
     }
@@ -210,23 +302,49 @@ status_t VintfObject::getCombinedFrameworkMatrix(
 
 // Load and combine all of the manifests in a directory
 status_t VintfObject::addDirectoryManifests(const std::string& directory, HalManifest* manifest,
-                                            std::string* error) {
+                                            std::string* error,
+                                            details::ManifestSources* sources) {
     std::vector<std::string> fileNames;
     status_t err = getFileSystem()->listFiles(directory, &fileNames, error);
     // if the directory isn't there, that's okay
     if (err == NAME_NOT_FOUND) return OK;
     if (err != OK) return err;
 
-    for (const std::string& file : fileNames) {
+    // Fragments are fetched and parsed into their own slots, on worker threads if concurrent
+    // checks are enabled, and merged in the order of fileNames so that overrides and the error
+    // message are the same as in the sequential mode.
+    struct Fragment {
+        status_t status = OK;
+        std::string error;
+        HalManifest manifest;
+    };
+    std::vector<Fragment> fragments(fileNames.size());
+    auto fetchFragment = [&](size_t i) {
+        Fragment& fragment = fragments[i];
+        if (error) fragment.error = *error;
+        fragment.status = fetchOneHalManifest(directory + fileNames[i], &fragment.manifest,
+                                              error ? &fragment.error : nullptr, nullptr);
+    };
+    if (mConcurrentChecks) {
+        parallelFor(fileNames.size(), std::thread::hardware_concurrency(), fetchFragment);
+    }
+
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+        if (!mConcurrentChecks) fetchFragment(i);
+        Fragment& fragment = fragments[i];
+        const std::string path = directory + fileNames[i];
+        if (fragment.status != OK) {
+            if (error) *error = std::move(fragment.error);
+            return fragment.status;
+        }
+        // Files are fetched in the order they are merged.
+        if (sources != nullptr) sources->emplace_back(path, fragment.manifest);
+
         // Only adds HALs because all other things are added by libvintf
         // itself for now.
-        HalManifest fragmentManifest;
-        err = fetchOneHalManifest(directory + file, &fragmentManifest, error);
-        if (err != OK) return err;
-
-        if (!manifest->addAll(&fragmentManifest, error)) {
+        if (!manifest->addAll(&fragment.manifest, error)) {
             if (error) {
-                error->insert(0, "Cannot add manifest fragment " + directory + file + ":");
+                error->insert(0, "Cannot add manifest fragment " + path + ":");
             }
             return UNKNOWN_ERROR;
         }
@@ -243,23 +361,25 @@ status_t VintfObject::addDirectoryManifests(const std::string& directory, HalMan
 // where:
 // A + B means unioning <hal> tags from A and B. If B declares an override, then this takes priority
 // over A.
-status_t VintfObject::fetchDeviceHalManifest(HalManifest* out, std::string* error) {
+status_t VintfObject::fetchDeviceHalManifest(HalManifest* out, std::string* error,
+                                             details::ManifestSources* sources) {
     HalManifest vendorManifest;
-    status_t vendorStatus = fetchVendorHalManifest(&vendorManifest, error);
+    status_t vendorStatus = fetchVendorHalManifest(&vendorManifest, error, sources);
     if (vendorStatus != OK && vendorStatus != NAME_NOT_FOUND) {
         return vendorStatus;
     }
 
     if (vendorStatus == OK) {
         *out = std::move(vendorManifest);
-        status_t fragmentStatus = addDirectoryManifests(kVendorManifestFragmentDir, out, error);
+        status_t fragmentStatus =
+            addDirectoryManifests(kVendorManifestFragmentDir, out, error, sources);
         if (fragmentStatus != OK) {
             return fragmentStatus;
         }
     }
 
     HalManifest odmManifest;
-    status_t odmStatus = fetchOdmHalManifest(&odmManifest, error);
+    status_t odmStatus = fetchOdmHalManifest(&odmManifest, error, sources);
     if (odmStatus != OK && odmStatus != NAME_NOT_FOUND) {
         return odmStatus;
     }
@@ -273,13 +393,13 @@ status_t VintfObject::fetchDeviceHalManifest(HalManifest* out, std::string* erro
                 return UNKNOWN_ERROR;
             }
         }
-        return addDirectoryManifests(kOdmManifestFragmentDir, out, error);
+        return addDirectoryManifests(kOdmManifestFragmentDir, out, error, sources);
     }
 
     // vendorStatus != OK, "out" is not changed.
     if (odmStatus == OK) {
         *out = std::move(odmManifest);
-        return addDirectoryManifests(kOdmManifestFragmentDir, out, error);
+        return addDirectoryManifests(kOdmManifestFragmentDir, out, error, sources);
     }
 
     // Use legacy /vendor/manifest.xml
@@ -291,7 +411,8 @@ status_t VintfObject::fetchDeviceHalManifest(HalManifest* out, std::string* erro
 // 2. /vendor/etc/vintf/manifest.xml
 // where:
 // {vendorSku} is the value of ro.boot.product.vendor.sku
-status_t VintfObject::fetchVendorHalManifest(HalManifest* out, std::string* error) {
+status_t VintfObject::fetchVendorHalManifest(HalManifest* out, std::string* error,
+                                             details::ManifestSources* sources) {
     status_t status;
 
     std::string vendorSku;
@@ -299,13 +420,14 @@ status_t VintfObject::fetchVendorHalManifest(HalManifest* out, std::string* erro
 
     if (!vendorSku.empty()) {
         status =
-            fetchOneHalManifest(kVendorVintfDir + "manifest_" + vendorSku + ".xml", out, error);
+            fetchOneHalManifest(kVendorVintfDir + "manifest_" + vendorSku + ".xml", out, error,
+                                sources);
         if (status == OK || status != NAME_NOT_FOUND) {
             return status;
         }
     }
 
-    status = fetchOneHalManifest(kVendorManifest, out, error);
+    status = fetchOneHalManifest(kVendorManifest, out, error, sources);
     if (status == OK || status != NAME_NOT_FOUND) {
         return status;
     }
@@ -321,7 +443,8 @@ status_t VintfObject::fetchVendorHalManifest(HalManifest* out, std::string* erro
 // 4. /odm/etc/manifest.xml
 // where:
 // {sku} is the value of ro.boot.product.hardware.sku
-status_t VintfObject::fetchOdmHalManifest(HalManifest* out, std::string* error) {
+status_t VintfObject::fetchOdmHalManifest(HalManifest* out, std::string* error,
+                                          details::ManifestSources* sources) {
     status_t status;
 
     std::string productModel;
@@ -329,26 +452,27 @@ status_t VintfObject::fetchOdmHalManifest(HalManifest* out, std::string* error)
 
     if (!productModel.empty()) {
         status =
-            fetchOneHalManifest(kOdmVintfDir + "manifest_" + productModel + ".xml", out, error);
+            fetchOneHalManifest(kOdmVintfDir + "manifest_" + productModel + ".xml", out, error,
+                                sources);
         if (status == OK || status != NAME_NOT_FOUND) {
             return status;
         }
     }
 
-    status = fetchOneHalManifest(kOdmManifest, out, error);
+    status = fetchOneHalManifest(kOdmManifest, out, error, sources);
     if (status == OK || status != NAME_NOT_FOUND) {
         return status;
     }
 
     if (!productModel.empty()) {
         status = fetchOneHalManifest(kOdmLegacyVintfDir + "manifest_" + productModel + ".xml", out,
-                                     error);
+                                     error, sources);
         if (status == OK || status != NAME_NOT_FOUND) {
             return status;
         }
     }
 
-    status = fetchOneHalManifest(kOdmLegacyManifest, out, error);
+    status = fetchOneHalManifest(kOdmLegacyManifest, out, error, sources);
     if (status == OK || status != NAME_NOT_FOUND) {
         return status;
     }
@@ -359,10 +483,12 @@ status_t VintfObject::fetchOdmHalManifest(HalManifest* out, std::string* error)
 // Fetch one manifest.xml file. "out" is written to iff return status is OK.
 // Returns NAME_NOT_FOUND if file is missing.
 status_t VintfObject::fetchOneHalManifest(const std::string& path, HalManifest* out,
-                                          std::string* error) {
+                                          std::string* error, details::ManifestSources* sources) {
     HalManifest ret;
     status_t status = ret.fetchAllInformation(getFileSystem().get(), path, error);
     if (status == OK) {
+        // Files are fetched in the order they are merged.
+        if (sources != nullptr) sources->emplace_back(path, ret);
         *out = std::move(ret);
     }
     return status;
@@ -383,10 +509,11 @@ status_t VintfObject::fetchDeviceMatrix(CompatibilityMatrix* out, std::string* e
 //    + /product/etc/vintf/manifest.xml if it exists
 //    + /product/etc/vintf/manifest/*.xml if they exist
 // 2. (deprecated) /system/manifest.xml
-status_t VintfObject::fetchFrameworkHalManifest(HalManifest* out, std::string* error) {
-    auto systemEtcStatus = fetchOneHalManifest(kSystemManifest, out, error);
+status_t VintfObject::fetchFrameworkHalManifest(HalManifest* out, std::string* error,
+                                                details::ManifestSources* sources) {
+    auto systemEtcStatus = fetchOneHalManifest(kSystemManifest, out, error, sources);
     if (systemEtcStatus == OK) {
-        auto dirStatus = addDirectoryManifests(kSystemManifestFragmentDir, out, error);
+        auto dirStatus = addDirectoryManifests(kSystemManifestFragmentDir, out, error, sources);
         if (dirStatus != OK) {
             return dirStatus;
         }
@@ -397,7 +524,7 @@ status_t VintfObject::fetchFrameworkHalManifest(HalManifest* out, std::string* e
         };
         for (auto&& [manifestPath, frags] : extensions) {
             HalManifest halManifest;
-            auto status = fetchOneHalManifest(manifestPath, &halManifest, error);
+            auto status = fetchOneHalManifest(manifestPath, &halManifest, error, sources);
             if (status != OK && status != NAME_NOT_FOUND) {
                 return status;
             }
@@ -410,7 +537,7 @@ status_t VintfObject::fetchFrameworkHalManifest(HalManifest* out, std::string* e
                 }
             }
 
-            auto fragmentStatus = addDirectoryManifests(frags, out, error);
+            auto fragmentStatus = addDirectoryManifests(frags, out, error, sources);
             if (fragmentStatus != OK) {
                 return fragmentStatus;
             }
@@ -431,6 +558,18 @@ static void appendLine(std::string* error, const std::string& message) {
     }
 }
 
+// Report checkError, the error of checkCompatibilityInternal() on an empty string, as if
+// that check had written to error directly: messages for missing inputs (status < 0) are
+// appended to error, and an incompatibility replaces it.
+static void reportCheckError(std::string* error, int32_t status, const std::string& checkError) {
+    if (error == nullptr || checkError.empty()) return;
+    if (status < 0) {
+        appendLine(error, checkError);
+    } else {
+        *error = checkError;
+    }
+}
+
 status_t VintfObject::getOneMatrix(const std::string& path, Named<CompatibilityMatrix>* out,
                                    std::string* error) {
     std::string content;
@@ -448,8 +587,28 @@ status_t VintfObject::getOneMatrix(const std::string& path, Named<CompatibilityM
     return OK;
 }
 
-status_t VintfObject::getAllFrameworkMatrixLevels(std::vector<Named<CompatibilityMatrix>>* results,
-                                                  std::string* error) {
+status_t VintfObject::getAllFrameworkMatrixLevels(
+    std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>>* out, std::string* error) {
+    if (mFrameworkSource != nullptr) {
+        return mFrameworkSource->getAllFrameworkMatrixLevels(out, error);
+    }
+
+    std::lock_guard<std::mutex> lock(mFrameworkMatrixLevels.mutex);
+    if (mFrameworkMatrixLevels.levels == nullptr) {
+        auto levels = std::make_shared<std::vector<Named<CompatibilityMatrix>>>();
+        status_t status = fetchAllFrameworkMatrixLevels(levels.get(), error);
+        // Errors are not cached; the fragments are read again on the next call.
+        if (status != OK) {
+            return status;
+        }
+        mFrameworkMatrixLevels.levels = std::move(levels);
+    }
+    *out = mFrameworkMatrixLevels.levels;
+    return OK;
+}
+
+status_t VintfObject::fetchAllFrameworkMatrixLevels(
+    std::vector<Named<CompatibilityMatrix>>* results, std::string* error) {
     std::vector<std::string> dirs = {
         kSystemVintfDir,
         kSystemExtVintfDir,
@@ -507,6 +666,9 @@ std::shared_ptr<const RuntimeInfo> VintfObject::getRuntimeInfo(bool skipCache,
                                                                RuntimeInfo::FetchFlags flags) {
     std::unique_lock<std::mutex> _lock(mDeviceRuntimeInfo.mutex);
 
+    // Fetching information into an object that is already fetched modifies it, so memoized
+    // results of checkCompatibility must be invalidated.
+    bool fetchedBefore = mDeviceRuntimeInfo.fetchedFlags != RuntimeInfo::FetchFlag::NONE;
     if (!skipCache) {
         flags &= (~mDeviceRuntimeInfo.fetchedFlags);
     }
@@ -526,11 +688,14 @@ std::shared_ptr<const RuntimeInfo> VintfObject::getRuntimeInfo(bool skipCache,
         if (manifest->kernel().has_value()) {
             level = manifest->kernel()->level();
         }
+        bool levelChanged = level != mDeviceRuntimeInfo.object->kernelLevel();
         mDeviceRuntimeInfo.object->setKernelLevel(level);
+        if (fetchedBefore && levelChanged) bumpGeneration();
         flags &= ~RuntimeInfo::FetchFlag::KERNEL_FCM;
     }
 
     status_t status = mDeviceRuntimeInfo.object->fetchAllInformation(flags);
+    if (fetchedBefore && flags != RuntimeInfo::FetchFlag::NONE) bumpGeneration();
     if (status != OK) {
         mDeviceRuntimeInfo.fetchedFlags &= (~flags);  // mark the fields as "not fetched"
         return nullptr;
@@ -540,64 +705,362 @@ std::shared_ptr<const RuntimeInfo> VintfObject::getRuntimeInfo(bool skipCache,
     return mDeviceRuntimeInfo.object;
 }
 
+status_t VintfObject::getRuntimeInfoIdentity(std::string* identity) {
+    std::unique_lock<std::mutex> _lock(mDeviceRuntimeInfo.mutex);
+    if (mDeviceRuntimeInfo.object == nullptr) {
+        mDeviceRuntimeInfo.object = getRuntimeInfoFactory()->make_shared();
+    }
+    return mDeviceRuntimeInfo.object->fetchIdentity(RuntimeInfo::FetchFlag::ALL, identity);
+}
+
+uint64_t VintfObject::getGeneration() const {
+    return mGeneration + (mFrameworkSource != nullptr ? mFrameworkSource->getGeneration() : 0);
+}
+
+void VintfObject::bumpGeneration() {
+    ++mGeneration;
+}
+
 int32_t VintfObject::checkCompatibility(std::string* error, CheckFlags::Type flags) {
+    // Read the generation before checking. If any object is fetched again while checking,
+    // the result is stored for an old generation and is not used.
+    uint64_t generation = getGeneration();
+    {
+        std::lock_guard<std::mutex> lock(mCheckResults.mutex);
+        auto it = mCheckResults.results.find(flags.value());
+        if (it != mCheckResults.results.end() && it->second.generation == generation &&
+            (error == nullptr || it->second.hasError)) {
+            reportCheckError(error, it->second.status, it->second.error);
+            return it->second.status;
+        }
+    }
+
+    std::string newError;
+    int32_t status = checkCompatibilityUnmemoized(error ? &newError : nullptr, flags);
+    // Errors (e.g. missing files) are not memoized.
+    if (status >= 0) {
+        std::lock_guard<std::mutex> lock(mCheckResults.mutex);
+        mCheckResults.results[flags.value()] = {generation, status, error != nullptr, newError};
+    }
+    reportCheckError(error, status, newError);
+    return status;
+}
+
+int32_t VintfObject::checkCompatibilityUnmemoized(std::string* error, CheckFlags::Type flags) {
+    if (mCompatibilityCache == nullptr) {
+        return checkCompatibilityInternal(error, flags);
+    }
+
+    // The key only identifies the runtime info cheaply; it is fetched and combined with the
+    // device manifest only if the result is computed. The kernel level is read from the
+    // device manifest, which is a recorded input.
+    std::string key = "flags=" + std::to_string(flags.value());
+    if (flags.isRuntimeInfoEnabled()) {
+        std::string identity;
+        if (getRuntimeInfoIdentity(&identity) != OK) {
+            return checkCompatibilityInternal(error, flags);
+        }
+        key += " runtime-info=" + details::fingerprint(identity);
+    }
+
+    int32_t status;
+    std::string cachedError;
+    if (mCompatibilityCache->lookup(key, &status, &cachedError)) {
+        LOG(INFO) << "checkCompatibility: using cached result " << status;
+        reportCheckError(error, status, cachedError);
+        return status;
+    }
+
+    std::string newError;
+    status = checkCompatibilityInternal(&newError, flags);
+    // Errors (e.g. missing files) are not cached.
+    if (status >= 0) {
+        mCompatibilityCache->store(key, status, newError);
+    }
+    reportCheckError(error, status, newError);
+    return status;
+}
+
+// Run func on a worker thread if concurrent. Otherwise, func is run on the calling thread
+// when the result is requested, so results requested in order are computed in order.
+template <typename F>
+static auto RunMaybeConcurrently(bool concurrent, F&& func) {
+    return std::async(concurrent ? std::launch::async : std::launch::deferred,
+                      std::forward<F>(func));
+}
+
+int32_t VintfObject::checkCompatibilityInternal(std::string* error, CheckFlags::Type flags) {
+    // The framework matrix depends on the device manifest, but getters are thread-safe and
+    // the second caller waits for the object fetched by the first one.
+    auto frameworkManifestFuture =
+        RunMaybeConcurrently(mConcurrentChecks, [this] { return getFrameworkHalManifest(); });
+    auto deviceManifestFuture =
+        RunMaybeConcurrently(mConcurrentChecks, [this] { return getDeviceHalManifest(); });
+    auto frameworkMatrixFuture = RunMaybeConcurrently(
+        mConcurrentChecks, [this] { return getFrameworkCompatibilityMatrix(); });
+    auto deviceMatrixFuture =
+        RunMaybeConcurrently(mConcurrentChecks, [this] { return getDeviceCompatibilityMatrix(); });
+    auto runtimeInfoFuture = RunMaybeConcurrently(
+        mConcurrentChecks && flags.isRuntimeInfoEnabled(),
+        [this, flags]() -> std::shared_ptr<const RuntimeInfo> {
+            return flags.isRuntimeInfoEnabled() ? getRuntimeInfo() : nullptr;
+        });
+
     status_t status = OK;
     // null checks for files and runtime info
-    if (getFrameworkHalManifest() == nullptr) {
+    auto frameworkManifest = frameworkManifestFuture.get();
+    if (frameworkManifest == nullptr) {
         appendLine(error, "No framework manifest file from device or from update package");
         status = NO_INIT;
     }
-    if (getDeviceHalManifest() == nullptr) {
+    auto deviceManifest = deviceManifestFuture.get();
+    if (deviceManifest == nullptr) {
         appendLine(error, "No device manifest file from device or from update package");
         status = NO_INIT;
     }
-    if (getFrameworkCompatibilityMatrix() == nullptr) {
+    auto frameworkMatrix = frameworkMatrixFuture.get();
+    if (frameworkMatrix == nullptr) {
         appendLine(error, "No framework matrix file from device or from update package");
         status = NO_INIT;
     }
-    if (getDeviceCompatibilityMatrix() == nullptr) {
+    auto deviceMatrix = deviceMatrixFuture.get();
+    if (deviceMatrix == nullptr) {
         appendLine(error, "No device matrix file from device or from update package");
         status = NO_INIT;
     }
 
+    auto runtimeInfo = runtimeInfoFuture.get();
     if (flags.isRuntimeInfoEnabled()) {
-        if (getRuntimeInfo() == nullptr) {
+        if (runtimeInfo == nullptr) {
             appendLine(error, "No runtime info from device");
             status = NO_INIT;
         }
     }
     if (status != OK) return status;
 
-    // compatiblity check.
-    if (!getDeviceHalManifest()->checkCompatibility(*getFrameworkCompatibilityMatrix(), error)) {
+    // compatiblity check. Each check writes to its own error message; they are reported
+    // in a fixed order below. If error is nullptr, the checks stop at the first failure and
+    // build no messages.
+    using CheckResult = std::pair<bool, std::string>;
+    auto deviceCheck = RunMaybeConcurrently(mConcurrentChecks, [&]() -> CheckResult {
+        std::string checkError;
+        std::string* checkErrorPtr = error ? &checkError : nullptr;
+        auto plan = GetCheckPlan(frameworkMatrix, &mFrameworkMatrixPlan);
+        bool ok = mIncrementalChecks
+                      ? CheckManifest(deviceManifest, frameworkMatrix, *plan,
+                                      &mDeviceManifestCheck, checkErrorPtr)
+                      : deviceManifest->checkCompatibility(*plan, checkErrorPtr);
+        return {ok, std::move(checkError)};
+    });
+    auto frameworkCheck = RunMaybeConcurrently(mConcurrentChecks, [&]() -> CheckResult {
+        std::string checkError;
+        std::string* checkErrorPtr = error ? &checkError : nullptr;
+        auto plan = GetCheckPlan(deviceMatrix, &mDeviceMatrixPlan);
+        bool ok = mIncrementalChecks
+                      ? CheckManifest(frameworkManifest, deviceMatrix, *plan,
+                                      &mFrameworkManifestCheck, checkErrorPtr)
+                      : frameworkManifest->checkCompatibility(*plan, checkErrorPtr);
+        return {ok, std::move(checkError)};
+    });
+    auto runtimeInfoCheck = RunMaybeConcurrently(
+        mConcurrentChecks && flags.isRuntimeInfoEnabled(), [&]() -> CheckResult {
+            if (!flags.isRuntimeInfoEnabled()) return {true, ""};
+            std::string checkError;
+            auto plan = GetCheckPlan(frameworkMatrix, &mFrameworkMatrixPlan);
+            bool ok =
+                runtimeInfo->checkCompatibility(*plan, error ? &checkError : nullptr, flags);
+            return {ok, std::move(checkError)};
+        });
+
+    if (auto [ok, checkError] = deviceCheck.get(); !ok) {
         if (error) {
-            error->insert(0,
-                          "Device manifest and framework compatibility matrix are incompatible: ");
+            *error = "Device manifest and framework compatibility matrix are incompatible: " +
+                     checkError;
         }
         return INCOMPATIBLE;
     }
-    if (!getFrameworkHalManifest()->checkCompatibility(*getDeviceCompatibilityMatrix(), error)) {
+    if (auto [ok, checkError] = frameworkCheck.get(); !ok) {
         if (error) {
-            error->insert(0,
-                          "Framework manifest and device compatibility matrix are incompatible: ");
+            *error = "Framework manifest and device compatibility matrix are incompatible: " +
+                     checkError;
         }
         return INCOMPATIBLE;
     }
 
-    if (flags.isRuntimeInfoEnabled()) {
-        if (!getRuntimeInfo()->checkCompatibility(*getFrameworkCompatibilityMatrix(), error,
-                                                  flags)) {
-            if (error) {
-                error->insert(0,
-                              "Runtime info and framework compatibility matrix are incompatible: ");
-            }
-        // return INCOMPATIBLE; // HACK
+    if (auto [ok, checkError] = runtimeInfoCheck.get(); !ok) {
+        if (error) {
+            *error = "Runtime info and framework compatibility matrix are incompatible: " +
+                     checkError;
         }
+        // return INCOMPATIBLE; // HACK
     }
 
     return COMPATIBLE;
 }
 
+// Return the CheckPlan of matrix, reusing the one in cache if it is built for the same matrix.
+// The returned plan keeps matrix alive.
+std::shared_ptr<const CheckPlan> VintfObject::GetCheckPlan(
+    const std::shared_ptr<const CompatibilityMatrix>& matrix, details::CheckPlanCache* cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (cache->matrix != matrix) {
+        cache->plan = std::shared_ptr<const CheckPlan>(
+            new CheckPlan(*matrix), [matrix](const CheckPlan* plan) { delete plan; });
+        cache->matrix = matrix;
+    }
+    return cache->plan;
+}
+
+std::vector<std::pair<int32_t, std::string>> VintfObject::CheckCompatibilityForAll(
+    const std::vector<VintfObject*>& objects, size_t numThreads, CheckFlags::Type flags) {
+    std::vector<std::pair<int32_t, std::string>> results(objects.size());
+    parallelFor(objects.size(), numThreads, [&](size_t i) {
+        auto& [status, error] = results[i];
+        status = objects[i]->checkCompatibility(&error, flags);
+    });
+    return results;
+}
+
+// Same as manifest->checkCompatibility(plan, error). If memo is computed from the same
+// manifest and matrix, only HALs changed since then are checked again.
+bool VintfObject::CheckManifest(const std::shared_ptr<const HalManifest>& manifest,
+                                const std::shared_ptr<const CompatibilityMatrix>& matrix,
+                                const CheckPlan& plan, details::HalCheckMemo* memo,
+                                std::string* error) {
+    // Requirements other than HALs are cheap to check.
+    static const std::set<std::string> kNoHals;
+    CompatibilityReport report;
+    bool ok = manifest->getCompatibilityReport(plan, &report, CheckFlags::DEFAULT, &kNoHals);
+    if (!ok && report.issues().front().type == CompatibilityIssue::Type::WRONG_TYPE) {
+        if (error) *error = report.toString();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(memo->mutex);
+    CompatibilityReport halReport;
+    if (memo->manifest == manifest && memo->matrix == matrix) {
+        for (const auto& name : memo->changedHals) memo->incompatibleHals.erase(name);
+        manifest->checkIncompatibleHals(plan, &halReport, &memo->changedHals);
+    } else {
+        memo->incompatibleHals.clear();
+        manifest->checkIncompatibleHals(plan, &halReport);
+        memo->manifest = manifest;
+        memo->matrix = matrix;
+    }
+    memo->changedHals.clear();
+    for (const auto& issue : halReport.issues()) {
+        memo->incompatibleHals.insert(issue.matrixHal->name);
+    }
+
+    if (!memo->incompatibleHals.empty()) {
+        if (error) {
+            CompatibilityReport incompatibleReport;
+            manifest->getCompatibilityReport(plan, &incompatibleReport, CheckFlags::DEFAULT,
+                                             &memo->incompatibleHals);
+            *error = incompatibleReport.toString();
+        }
+        return false;
+    }
+    if (!ok && error) *error = report.toString();
+    return ok;
+}
+
+// Merge the new content of the fragment at path into the manifest in ptr, which is assembled
+// from sources. Only HALs named in the old or new fragment are merged again, and they are
+// marked as changed in memo. Return NAME_NOT_FOUND if path is not one of the sources or
+// if it changes anything other than HALs.
+status_t VintfObject::remergeManifestFragment(const std::string& path,
+                                              details::LockedSharedPtr<HalManifest>* ptr,
+                                              details::ManifestSources* sources,
+                                              details::HalCheckMemo* memo, std::string* error) {
+    std::unique_lock<std::mutex> lock(ptr->mutex);
+    if (ptr->object == nullptr) return NAME_NOT_FOUND;
+    auto it = std::find_if(sources->begin(), sources->end(),
+                           [&path](const auto& source) { return source.first == path; });
+    if (it == sources->end()) return NAME_NOT_FOUND;
+
+    HalManifest newSource;
+    newSource.setType(it->second.type());
+    std::string fetchError;
+    status_t status = fetchOneHalManifest(path, &newSource, &fetchError);
+    if (status != OK && status != NAME_NOT_FOUND) {
+        if (error) *error = fetchError;
+        return status;
+    }
+    // A deleted fragment contributes nothing.
+    bool deleted = status == NAME_NOT_FOUND;
+
+    std::set<std::string> changedHals = it->second.getHalNames();
+    for (const auto& name : newSource.getHalNames()) changedHals.insert(name);
+
+    HalManifest oldRest = it->second;
+    HalManifest newRest = newSource;
+    oldRest.mHals.clear();
+    newRest.mHals.clear();
+    if (!(oldRest == newRest)) {
+        return NAME_NOT_FOUND;
+    }
+
+    auto manifest = std::make_shared<HalManifest>(*ptr->object);
+    for (const auto& name : changedHals) {
+        manifest->mHals.erase(name);
+    }
+    for (auto sourceIt = sources->begin(); sourceIt != sources->end(); ++sourceIt) {
+        const HalManifest& source = sourceIt == it ? newSource : sourceIt->second;
+        for (const auto& name : changedHals) {
+            for (const ManifestHal* hal : source.getHals(name)) {
+                if (!manifest->add(ManifestHal(*hal))) {
+                    if (error) {
+                        *error = "Cannot add manifest fragment " + sourceIt->first + ": HAL \"" +
+                                 name + "\" has a conflict.";
+                    }
+                    return UNKNOWN_ERROR;
+                }
+            }
+        }
+    }
+
+    if (deleted) {
+        sources->erase(it);
+    } else {
+        it->second = std::move(newSource);
+    }
+    {
+        std::lock_guard<std::mutex> memoLock(memo->mutex);
+        if (memo->manifest == ptr->object) {
+            memo->manifest = manifest;
+            memo->changedHals.insert(changedHals.begin(), changedHals.end());
+        }
+    }
+    ptr->object = manifest;
+    return OK;
+}
+
+int32_t VintfObject::recheckCompatibility(const std::string& fragmentPath, std::string* error,
+                                          CheckFlags::Type flags) {
+    std::string remergeError;
+    status_t status = remergeManifestFragment(fragmentPath, &mDeviceManifest,
+                                              &mDeviceManifestSources, &mDeviceManifestCheck,
+                                              &remergeError);
+    if (status == NAME_NOT_FOUND) {
+        status = remergeManifestFragment(fragmentPath, &mFrameworkManifest,
+                                         &mFrameworkManifestSources, &mFrameworkManifestCheck,
+                                         &remergeError);
+    }
+    if (status == NAME_NOT_FOUND) {
+        LOG(INFO) << __func__ << ": Reading all VINTF information again for " << fragmentPath;
+        getDeviceHalManifest(true /* skipCache */);
+        getFrameworkHalManifest(true /* skipCache */);
+        getDeviceCompatibilityMatrix(true /* skipCache */);
+        getFrameworkCompatibilityMatrix(true /* skipCache */);
+    } else if (status != OK) {
+        appendLine(error, remergeError);
+        return status;
+    }
+    bumpGeneration();
+    return checkCompatibility(error, flags);
+}
+
 namespace details {
 
 const std::string kSystemVintfDir = "/system/etc/vintf/";
@@ -649,10 +1112,11 @@ std::vector<std::string> dumpFileList() {
 bool VintfObject::IsHalDeprecated(const MatrixHal& oldMatrixHal,
                                   const CompatibilityMatrix& targetMatrix,
                                   const ListInstances& listInstances,
-                                  const ChildrenMap& childrenMap, std::string* appendedError) {
+                                  const HidlInheritanceGraph& inheritance,
+                                  std::string* appendedError) {
     bool isDeprecated = false;
     oldMatrixHal.forEachInstance([&](const MatrixInstance& oldMatrixInstance) {
-        if (IsInstanceDeprecated(oldMatrixInstance, targetMatrix, listInstances, childrenMap,
+        if (IsInstanceDeprecated(oldMatrixInstance, targetMatrix, listInstances, inheritance,
                                  appendedError)) {
             isDeprecated = true;
         }
@@ -668,7 +1132,8 @@ bool VintfObject::IsHalDeprecated(const MatrixHal& oldMatrixHal,
 bool VintfObject::IsInstanceDeprecated(const MatrixInstance& oldMatrixInstance,
                                        const CompatibilityMatrix& targetMatrix,
                                        const ListInstances& listInstances,
-                                       const ChildrenMap& childrenMap, std::string* appendedError) {
+                                       const HidlInheritanceGraph& inheritance,
+                                       std::string* appendedError) {
     const std::string& package = oldMatrixInstance.package();
     const Version& version = oldMatrixInstance.versionRange().minVer();
     const std::string& interface = oldMatrixInstance.interface();
@@ -691,15 +1156,15 @@ bool VintfObject::IsInstanceDeprecated(const MatrixInstance& oldMatrixInstance,
             continue;
         }
 
-        auto inheritance = GetListedInstanceInheritance(package, servedVersion, interface,
-                                                        servedInstance, listInstances, childrenMap);
-        if (!inheritance.has_value()) {
-            accumulatedErrors.push_back(inheritance.error().message());
+        auto listedInheritance = GetListedInstanceInheritance(
+            package, servedVersion, interface, servedInstance, listInstances, inheritance);
+        if (!listedInheritance.has_value()) {
+            accumulatedErrors.push_back(listedInheritance.error().message());
             continue;
         }
 
         std::vector<std::string> errors;
-        for (const auto& fqInstance : *inheritance) {
+        for (const auto& fqInstance : *listedInheritance) {
             auto result = IsFqInstanceDeprecated(targetMatrix, oldMatrixInstance.format(),
                                                  fqInstance, listInstances);
             if (result.ok()) {
@@ -734,11 +1199,11 @@ bool VintfObject::IsInstanceListed(const ListInstances& listInstances,
 
 // Return a list of FqInstance, where each element:
 // - is listed in |listInstances|; AND
-// - is, or inherits from, package@version::interface/instance (as specified by |childrenMap|)
+// - is, or inherits from, package@version::interface/instance (as specified by |inheritance|)
 android::base::Result<std::vector<FqInstance>> VintfObject::GetListedInstanceInheritance(
     const std::string& package, const Version& version, const std::string& interface,
     const std::string& instance, const ListInstances& listInstances,
-    const ChildrenMap& childrenMap) {
+    const HidlInheritanceGraph& inheritance) {
     FqInstance fqInstance;
     if (!fqInstance.setTo(package, version.majorVer, version.minorVer, interface, instance)) {
         return android::base::Error() << toFQNameString(package, version, interface, instance)
@@ -754,16 +1219,19 @@ android::base::Result<std::vector<FqInstance>> VintfObject::GetListedInstanceInh
     std::vector<FqInstance> ret;
     ret.push_back(fqInstance);
 
-    auto childRange = childrenMap.equal_range(fqName.string());
-    for (auto it = childRange.first; it != childRange.second; ++it) {
-        const auto& childFqNameString = it->second;
-        FQName childFqName;
-        if (!childFqName.setTo(childFqNameString)) {
-            return android::base::Error() << "Cannot parse " << childFqNameString << " as FQName";
+    auto node = inheritance.find(fqName.string());
+    if (!node.has_value()) {
+        return ret;
+    }
+    for (auto child : inheritance.children(*node)) {
+        const FQName* childFqName = inheritance.fqName(child);
+        if (childFqName == nullptr) {
+            return android::base::Error()
+                   << "Cannot parse " << inheritance.name(child) << " as FQName";
         }
         FqInstance childFqInstance;
-        if (!childFqInstance.setTo(childFqName, fqInstance.getInstance())) {
-            return android::base::Error() << "Cannot merge " << childFqName.string() << "/"
+        if (!childFqInstance.setTo(*childFqName, fqInstance.getInstance())) {
+            return android::base::Error() << "Cannot merge " << childFqName->string() << "/"
                                           << fqInstance.getInstance() << " as FqInstance";
             continue;
         }
@@ -824,12 +1292,47 @@ android::base::Result<void> VintfObject::IsFqInstanceDeprecated(
 int32_t VintfObject::checkDeprecation(const ListInstances& listInstances,
                                       const std::vector<HidlInterfaceMetadata>& hidlMetadata,
                                       std::string* error) {
-    std::vector<Named<CompatibilityMatrix>> matrixFragments;
+    return checkDeprecation(listInstances, HidlInheritanceGraph(hidlMetadata), error);
+}
+
+VintfObject::ListInstances VintfObject::MemoizeListInstances(ListInstances listInstances) {
+    using Key = std::tuple<std::string, Version, std::string, std::vector<std::string>>;
+    using Value = std::vector<std::pair<std::string, Version>>;
+    struct Memo {
+        ListInstances listInstances;
+        std::mutex mutex;
+        std::map<Key, Value> results;
+    };
+    auto memo = std::make_shared<Memo>();
+    memo->listInstances = std::move(listInstances);
+    return [memo](const std::string& package, Version version, const std::string& interface,
+                  const std::vector<std::string>& hintInstances) {
+        Key key{package, version, interface, hintInstances};
+        {
+            std::lock_guard<std::mutex> lock(memo->mutex);
+            auto it = memo->results.find(key);
+            if (it != memo->results.end()) return it->second;
+        }
+        // Do not hold the lock while listing; concurrent queries for the same arguments
+        // may both call listInstances, but they store the same result.
+        Value value = memo->listInstances(package, version, interface, hintInstances);
+        std::lock_guard<std::mutex> lock(memo->mutex);
+        return memo->results.emplace(std::move(key), std::move(value)).first->second;
+    };
+}
+
+int32_t VintfObject::checkDeprecation(const ListInstances& rawListInstances,
+                                      const HidlInheritanceGraph& inheritance, std::string* error,
+                                      bool listInstancesIsThreadSafe) {
+    // The same instances are listed again for each old matrix and each inherited interface.
+    ListInstances listInstances = MemoizeListInstances(rawListInstances);
+
+    std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>> matrixFragments;
     auto matrixFragmentsStatus = getAllFrameworkMatrixLevels(&matrixFragments, error);
     if (matrixFragmentsStatus != OK) {
         return matrixFragmentsStatus;
     }
-    if (matrixFragments.empty()) {
+    if (matrixFragments->empty()) {
         if (error && error->empty()) {
             *error = "Cannot get framework matrix for each FCM version for unknown error.";
         }
@@ -847,7 +1350,7 @@ int32_t VintfObject::checkDeprecation(const ListInstances& listInstances,
     }
 
     const CompatibilityMatrix* targetMatrix = nullptr;
-    for (const auto& namedMatrix : matrixFragments) {
+    for (const auto& namedMatrix : *matrixFragments) {
         if (namedMatrix.object.level() == deviceLevel) {
             targetMatrix = &namedMatrix.object;
         }
@@ -858,33 +1361,47 @@ int32_t VintfObject::checkDeprecation(const ListInstances& listInstances,
         return NAME_NOT_FOUND;
     }
 
-    std::multimap<std::string, std::string> childrenMap;
-    for (const auto& child : hidlMetadata) {
-        for (const auto& parent : child.inherited) {
-            childrenMap.emplace(parent, child.name);
-        }
-    }
-
     // Find a list of possibly deprecated HALs by comparing |listInstances| with older matrices.
     // Matrices with unspecified level are considered "current".
-    bool isDeprecated = false;
-    for (const auto& namedMatrix : matrixFragments) {
+    std::vector<const MatrixHal*> oldHals;
+    for (const auto& namedMatrix : *matrixFragments) {
         if (namedMatrix.object.level() == Level::UNSPECIFIED) continue;
         if (namedMatrix.object.level() >= deviceLevel) continue;
 
         const auto& oldMatrix = namedMatrix.object;
         for (const MatrixHal& hal : oldMatrix.getHals()) {
-            if (IsHalDeprecated(hal, *targetMatrix, listInstances, childrenMap, error)) {
-                isDeprecated = true;
-            }
+            oldHals.push_back(&hal);
         }
     }
 
+    // Each HAL is checked into its own slot, and slots are merged in order so that the error
+    // message does not depend on the number of threads.
+    struct HalResult {
+        bool deprecated = false;
+        std::string error;
+    };
+    std::vector<HalResult> results(oldHals.size());
+    size_t numThreads = listInstancesIsThreadSafe ? std::thread::hardware_concurrency() : 1;
+    parallelFor(oldHals.size(), numThreads, [&](size_t i) {
+        results[i].deprecated = IsHalDeprecated(*oldHals[i], *targetMatrix, listInstances,
+                                                inheritance, error ? &results[i].error : nullptr);
+    });
+
+    bool isDeprecated = false;
+    for (const auto& result : results) {
+        if (!result.error.empty()) appendLine(error, result.error);
+        isDeprecated |= result.deprecated;
+    }
     return isDeprecated ? DEPRECATED : NO_DEPRECATED_HALS;
 }
 
 int32_t VintfObject::checkDeprecation(const std::vector<HidlInterfaceMetadata>& hidlMetadata,
                                       std::string* error) {
+    return checkDeprecation(HidlInheritanceGraph(hidlMetadata), error);
+}
+
+int32_t VintfObject::checkDeprecation(const HidlInheritanceGraph& inheritance,
+                                      std::string* error) {
     using namespace std::placeholders;
     auto deviceManifest = getDeviceHalManifest();
     ListInstances inManifest =
@@ -900,7 +1417,8 @@ int32_t VintfObject::checkDeprecation(const std::vector<HidlInterfaceMetadata>&
                 });
             return ret;
         };
-    return checkDeprecation(inManifest, hidlMetadata, error);
+    // inManifest only reads the device manifest.
+    return checkDeprecation(inManifest, inheritance, error, mConcurrentChecks);
 }
 
 Level VintfObject::getKernelLevel(std::string* error) {
@@ -929,14 +1447,14 @@ const std::unique_ptr<ObjectFactory<RuntimeInfo>>& VintfObject::getRuntimeInfoFa
 }
 
 android::base::Result<bool> VintfObject::hasFrameworkCompatibilityMatrixExtensions() {
-    std::vector<Named<CompatibilityMatrix>> matrixFragments;
+    std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>> matrixFragments;
     std::string error;
     status_t status = getAllFrameworkMatrixLevels(&matrixFragments, &error);
     if (status != OK) {
         return android::base::Error(-status)
                << "Cannot get all framework matrix fragments: " << error;
     }
-    for (const auto& namedMatrix : matrixFragments) {
+    for (const auto& namedMatrix : *matrixFragments) {
         // Returns true if product matrix exists.
         if (android::base::StartsWith(namedMatrix.name, kProductVintfDir)) {
             return true;
@@ -957,6 +1475,10 @@ android::base::Result<bool> VintfObject::hasFrameworkCompatibilityMatrixExtensio
 
 android::base::Result<void> VintfObject::checkUnusedHals(
     const std::vector<HidlInterfaceMetadata>& hidlMetadata) {
+    return checkUnusedHals(HidlInheritanceGraph(hidlMetadata));
+}
+
+android::base::Result<void> VintfObject::checkUnusedHals(const HidlInheritanceGraph& inheritance) {
     auto matrix = getFrameworkCompatibilityMatrix();
     if (matrix == nullptr) {
         return android::base::Error(-NAME_NOT_FOUND) << "Missing framework matrix.";
@@ -965,7 +1487,7 @@ android::base::Result<void> VintfObject::checkUnusedHals(
     if (manifest == nullptr) {
         return android::base::Error(-NAME_NOT_FOUND) << "Missing device manifest.";
     }
-    auto unused = manifest->checkUnusedHals(*matrix, hidlMetadata);
+    auto unused = manifest->checkUnusedHals(*matrix, inheritance);
     if (!unused.empty()) {
         return android::base::Error()
                << "The following instances are in the device manifest but "
@@ -1003,11 +1525,63 @@ VintfObject::Builder& VintfObject::Builder::setPropertyFetcher(
     return *this;
 }
 
+VintfObject::Builder& VintfObject::Builder::setConcurrentChecks(bool concurrent) {
+    mObject->mConcurrentChecks = concurrent;
+    return *this;
+}
+
+VintfObject::Builder& VintfObject::Builder::setIncrementalChecks(bool incremental) {
+    mObject->mIncrementalChecks = incremental;
+    return *this;
+}
+
+VintfObject::Builder& VintfObject::Builder::setCompatibilityCache(const std::string& path) {
+    mCompatibilityCachePath = path;
+    return *this;
+}
+
+VintfObject::Builder& VintfObject::Builder::setObjectCache(const std::string& path) {
+    mObjectCachePath = path;
+    return *this;
+}
+
+VintfObject::Builder& VintfObject::Builder::setFrameworkSource(
+    std::shared_ptr<VintfObject> framework) {
+    mObject->mFrameworkSource = std::move(framework);
+    return *this;
+}
+
 std::unique_ptr<VintfObject> VintfObject::Builder::build() {
     if (!mObject->mFileSystem) mObject->mFileSystem = createDefaultFileSystem();
     if (!mObject->mRuntimeInfoFactory)
         mObject->mRuntimeInfoFactory = std::make_unique<ObjectFactory<RuntimeInfo>>();
     if (!mObject->mPropertyFetcher) mObject->mPropertyFetcher = createDefaultPropertyFetcher();
+    if (!mObjectCachePath.empty() && mObject->mIncrementalChecks) {
+        LOG(WARNING) << "Ignoring object cache " << mObjectCachePath
+                     << " because incremental checks are enabled.";
+        mObjectCachePath.clear();
+    }
+    if (mObject->mFrameworkSource != nullptr) {
+        for (const auto& path : {mCompatibilityCachePath, mObjectCachePath}) {
+            if (path.empty()) continue;
+            LOG(WARNING) << "Ignoring cache " << path << " because a framework source is set.";
+        }
+    } else if (!mCompatibilityCachePath.empty() || !mObjectCachePath.empty()) {
+        // Both caches record the inputs through the same dependencies.
+        auto fileSystem = std::make_unique<RecordingFileSystem>(std::move(mObject->mFileSystem));
+        auto propertyFetcher =
+            std::make_unique<RecordingPropertyFetcher>(std::move(mObject->mPropertyFetcher));
+        if (!mCompatibilityCachePath.empty()) {
+            mObject->mCompatibilityCache = std::make_unique<CompatibilityCache>(
+                mCompatibilityCachePath, fileSystem.get(), propertyFetcher.get());
+        }
+        if (!mObjectCachePath.empty()) {
+            mObject->mObjectCache = std::make_unique<ObjectCache>(
+                mObjectCachePath, fileSystem.get(), propertyFetcher.get());
+        }
+        mObject->mFileSystem = std::move(fileSystem);
+        mObject->mPropertyFetcher = std::move(propertyFetcher);
+    }
     return std::move(mObject);
 }
 
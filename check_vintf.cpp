@@ -21,6 +21,7 @@
 #include <iostream>
 #include <map>
 #include <optional>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -56,6 +57,8 @@ enum Option : int {
     PROPERTY,
     DIR_MAP,
     KERNEL,
+    DEVICE,
+    JOBS,
 };
 // command line arguments
 using Args = std::multimap<Option, std::string>;
@@ -84,6 +87,14 @@ class HostFileSystem : public details::FileSystemImpl {
         LOG(INFO) << "List '" << resolved << "': " << toString(status);
         return status;
     }
+    status_t getStat(const std::string& path, FileStat* out,
+                     std::string* error) const override {
+        auto resolved = resolve(path, error);
+        if (resolved.empty()) {
+            return mMissingError;
+        }
+        return details::FileSystemImpl::getStat(resolved, out, error);
+    }
 
    private:
     static std::string toString(status_t status) {
@@ -240,12 +251,14 @@ Args parseArgs(int argc, char** argv) {
         {"property", required_argument, &longOptFlag, PROPERTY},
         {"dirmap", required_argument, &longOptFlag, DIR_MAP},
         {"kernel", required_argument, &longOptFlag, KERNEL},
+        {"device", required_argument, &longOptFlag, DEVICE},
+        {"jobs", required_argument, &longOptFlag, JOBS},
         {0, 0, 0, 0}};
     std::map<int, Option> shortopts{
-        {'h', HELP}, {'D', PROPERTY}, {'c', CHECK_COMPAT},
+        {'h', HELP}, {'D', PROPERTY}, {'c', CHECK_COMPAT}, {'j', JOBS},
     };
     for (;;) {
-        int c = getopt_long(argc, argv, "hcD:", longopts.data(), &optionIndex);
+        int c = getopt_long(argc, argv, "hcD:j:", longopts.data(), &optionIndex);
         if (c == -1) {
             break;
         }
@@ -323,6 +336,17 @@ int usage(const char* me) {
         << "        --dirmap </system:/dir/to/system> [--dirmap </vendor:/dir/to/vendor>[...]]"
         << std::endl
         << "                Map partitions to directories. Cannot be specified with --rootdir."
+        << std::endl
+        << "        --device <dir> [--device <dir> [...]]" << std::endl
+        << "                With --check-compat, check each device against the same framework."
+        << std::endl
+        << "                /vendor and /odm are mapped to <dir>/vendor and <dir>/odm; other"
+        << std::endl
+        << "                partitions are mapped by --dirmap. The framework side is read once."
+        << std::endl
+        << "        -j, --jobs <n>: with --device, check up to n devices at the same time."
+        << std::endl
+        << "                Default is the number of CPUs." << std::endl
         << "        --kernel <x.y.z:path/to/config>" << std::endl
         << "                Use the given kernel version and config to check. If" << std::endl
         << "                unspecified, kernel requirements are skipped." << std::endl
@@ -372,20 +396,24 @@ void AddResult(std::optional<android::base::Error>* retError,
     SetErrorCode(retError, other.error().code()) << other.error();
 }
 
-android::base::Result<void> checkAllFiles(const Dirmap& dirmap, const Properties& props,
-                                          std::shared_ptr<StaticRuntimeInfo> runtimeInfo) {
+std::unique_ptr<VintfObject> buildVintfObject(const Dirmap& dirmap, const Properties& props,
+                                              std::shared_ptr<StaticRuntimeInfo> runtimeInfo,
+                                              std::shared_ptr<VintfObject> framework = nullptr) {
     auto hostPropertyFetcher = std::make_unique<PresetPropertyFetcher>();
     hostPropertyFetcher->setProperties(props);
 
-    CheckFlags::Type flags = CheckFlags::DEFAULT;
-    if (!runtimeInfo) flags = flags.disableRuntimeInfo();
+    return VintfObject::Builder()
+        .setFileSystem(std::make_unique<HostFileSystem>(dirmap, UNKNOWN_ERROR))
+        .setPropertyFetcher(std::move(hostPropertyFetcher))
+        .setRuntimeInfoFactory(std::make_unique<StaticRuntimeInfoFactory>(runtimeInfo))
+        .setFrameworkSource(std::move(framework))
+        .build();
+}
 
-    auto vintfObject =
-        VintfObject::Builder()
-            .setFileSystem(std::make_unique<HostFileSystem>(dirmap, UNKNOWN_ERROR))
-            .setPropertyFetcher(std::move(hostPropertyFetcher))
-            .setRuntimeInfoFactory(std::make_unique<StaticRuntimeInfoFactory>(runtimeInfo))
-            .build();
+android::base::Result<void> checkAllFiles(VintfObject* vintfObject, bool hasRuntimeInfo,
+                                          const HidlInheritanceGraph& inheritance) {
+    CheckFlags::Type flags = CheckFlags::DEFAULT;
+    if (!hasRuntimeInfo) flags = flags.disableRuntimeInfo();
 
     std::optional<android::base::Error> retError = std::nullopt;
 
@@ -397,10 +425,8 @@ android::base::Result<void> checkAllFiles(const Dirmap& dirmap, const Properties
         SetErrorCode(&retError, -compatibleResult) << compatibleError;
     }
 
-    auto hidlMetadata = HidlInterfaceMetadata::all();
-
     std::string deprecateError;
-    int deprecateResult = vintfObject->checkDeprecation(hidlMetadata, &deprecateError);
+    int deprecateResult = vintfObject->checkDeprecation(inheritance, &deprecateError);
     if (deprecateResult == DEPRECATED) {
         SetErrorCode(&retError) << deprecateError;
     } else if (deprecateResult != NO_DEPRECATED_HALS) {
@@ -419,7 +445,7 @@ android::base::Result<void> checkAllFiles(const Dirmap& dirmap, const Properties
     }
 
     if (hasFcmExt.value_or(false) || (targetFcm != Level::UNSPECIFIED && targetFcm >= Level::R)) {
-        AddResult(&retError, vintfObject->checkUnusedHals(hidlMetadata));
+        AddResult(&retError, vintfObject->checkUnusedHals(inheritance));
     } else {
         LOG(INFO) << "Skip checking unused HALs.";
     }
@@ -431,6 +457,59 @@ android::base::Result<void> checkAllFiles(const Dirmap& dirmap, const Properties
     }
 }
 
+android::base::Result<void> checkAllFiles(const Dirmap& dirmap, const Properties& props,
+                                          std::shared_ptr<StaticRuntimeInfo> runtimeInfo,
+                                          const HidlInheritanceGraph& inheritance) {
+    auto vintfObject = buildVintfObject(dirmap, props, runtimeInfo);
+    return checkAllFiles(vintfObject.get(), runtimeInfo != nullptr, inheritance);
+}
+
+// Print and return the exit code for the result of checkAllFiles.
+int reportResult(const android::base::Result<void>& compat, const std::string& prefix = "") {
+    if (compat.ok()) {
+        std::cout << prefix << "COMPATIBLE" << std::endl;
+        return EX_OK;
+    }
+    if (compat.error().code() == 0) {
+        LOG(ERROR) << prefix << "files are incompatible: " << compat.error();
+        std::cout << prefix << "INCOMPATIBLE" << std::endl;
+        return EX_DATAERR;
+    }
+    LOG(ERROR) << prefix << strerror(compat.error().code()) << ": " << compat.error();
+    return EX_SOFTWARE;
+}
+
+// Check each of deviceDirs against the framework in dirmap on up to jobs threads. The
+// framework manifest and matrices are read once and shared by all devices.
+int checkAllDevices(const Dirmap& dirmap, const std::vector<std::string>& deviceDirs,
+                    const Properties& props, const StaticRuntimeInfo* runtimeInfo, size_t jobs,
+                    const HidlInheritanceGraph& inheritance) {
+    std::shared_ptr<VintfObject> framework = buildVintfObject(dirmap, props, nullptr);
+
+    std::vector<std::unique_ptr<VintfObject>> devices;
+    for (const auto& deviceDir : deviceDirs) {
+        Dirmap deviceDirmap = dirmap;
+        deviceDirmap["/vendor"] = deviceDir + "/vendor";
+        deviceDirmap["/odm"] = deviceDir + "/odm";
+        // Each device fetches into its own RuntimeInfo.
+        auto deviceRuntimeInfo =
+            runtimeInfo ? std::make_shared<StaticRuntimeInfo>(*runtimeInfo) : nullptr;
+        devices.push_back(buildVintfObject(deviceDirmap, props, deviceRuntimeInfo, framework));
+    }
+
+    std::vector<android::base::Result<void>> results(devices.size());
+    parallelFor(devices.size(), jobs, [&](size_t i) {
+        results[i] = checkAllFiles(devices[i].get(), runtimeInfo != nullptr, inheritance);
+    });
+
+    int exitCode = EX_OK;
+    for (size_t i = 0; i < results.size(); ++i) {
+        int deviceExitCode = reportResult(results[i], deviceDirs[i] + ": ");
+        if (deviceExitCode == EX_SOFTWARE || exitCode == EX_OK) exitCode = deviceExitCode;
+    }
+    return exitCode;
+}
+
 int checkDirmaps(const Dirmap& dirmap, const Properties& props) {
     auto hostPropertyFetcher = std::make_unique<PresetPropertyFetcher>();
     hostPropertyFetcher->setProperties(props);
@@ -544,17 +623,21 @@ int main(int argc, char** argv) {
         return usage(argv[0]);
     }
 
-    auto compat = checkAllFiles(dirmap, properties, runtimeInfo);
+    // Shared by all devices in --device mode.
+    HidlInheritanceGraph inheritance(HidlInterfaceMetadata::all());
 
-    if (compat.ok()) {
-        std::cout << "COMPATIBLE" << std::endl;
-        return EX_OK;
-    }
-    if (compat.error().code() == 0) {
-        LOG(ERROR) << "files are incompatible: " << compat.error();
-        std::cout << "INCOMPATIBLE" << std::endl;
-        return EX_DATAERR;
+    auto deviceArgs = iterateValues(args, DEVICE);
+    if (!deviceArgs.empty()) {
+        size_t jobs = std::thread::hardware_concurrency();
+        auto jobsArgs = iterateValues(args, JOBS);
+        if (!jobsArgs.empty() && !android::base::ParseUint(*jobsArgs.begin(), &jobs)) {
+            LOG(ERROR) << "Invalid --jobs " << *jobsArgs.begin();
+            return usage(argv[0]);
+        }
+        std::vector<std::string> deviceDirs(deviceArgs.begin(), deviceArgs.end());
+        return checkAllDevices(dirmap, deviceDirs, properties, runtimeInfo.get(), jobs,
+                               inheritance);
     }
-    LOG(ERROR) << strerror(compat.error().code()) << ": " << compat.error();
-    return EX_SOFTWARE;
+
+    return reportResult(checkAllFiles(dirmap, properties, runtimeInfo, inheritance));
 }
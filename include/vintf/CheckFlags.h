@@ -37,6 +37,8 @@ class Type {
 
     explicit constexpr Type(int32_t value) : mValue(value) {}
 
+    constexpr int32_t value() const { return mValue; }
+
    private:
     int32_t mValue;
 };
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_CHECK_PLAN_H
+#define ANDROID_VINTF_CHECK_PLAN_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "FqInstanceView.h"
+#include "KernelConfigIndex.h"
+#include "KernelInfo.h"
+#include "Regex.h"
+#include "Version.h"
+#include "VersionRange.h"
+
+namespace android {
+namespace vintf {
+
+struct CompatibilityMatrix;
+struct MatrixHal;
+struct MatrixKernel;
+
+namespace details {
+
+// A MatrixHal with its instances flattened and its regular expressions compiled.
+// The MatrixHal must outlive this object.
+class CompiledMatrixHal {
+   public:
+    explicit CompiledMatrixHal(const MatrixHal& hal);
+
+    const MatrixHal& hal() const { return *mHal; }
+
+    // providedInstances must only contain instances of this HAL.
+    bool isCompatible(const FqInstanceIndex& providedInstances,
+                      const std::set<Version>& providedVersions) const;
+
+    // True if any of providedVersions satisfies a version range, regardless of instances.
+    bool isVersionSupported(const std::set<Version>& providedVersions) const;
+
+   private:
+    bool isCompatible(const VersionRange& vr, const FqInstanceIndex& providedInstances,
+                      const std::set<Version>& providedVersions) const;
+
+    const MatrixHal* mHal;
+    // (interface, instance)
+    std::vector<std::pair<std::string_view, std::string_view>> mInstances;
+    // (interface, pattern)
+    std::vector<std::pair<std::string_view, std::unique_ptr<Regex>>> mRegexes;
+    // False if any pattern is not a valid regular expression.
+    bool mRegexesValid = true;
+};
+
+}  // namespace details
+
+// A CompatibilityMatrix preprocessed for checking many HalManifests and RuntimeInfos
+// against it: required HALs are grouped by name with their regular expressions compiled,
+// and kernel requirements are indexed by kernel version x.y and source matrix level, with
+// their configs compiled into a KernelConfigIndex. Each of these parts is only built
+// when a check first uses it, so a plan for a single check costs no more than checking
+// the matrix directly.
+// The matrix must outlive the plan and must not be modified. The plan is thread-safe.
+class CheckPlan {
+   public:
+    explicit CheckPlan(const CompatibilityMatrix& mat);
+
+    const CompatibilityMatrix& matrix() const { return *mMatrix; }
+
+   private:
+    friend struct HalManifest;
+    friend struct RuntimeInfo;
+
+    using RequiredHals =
+        std::vector<std::pair<std::string_view, std::vector<details::CompiledMatrixHal>>>;
+
+    // Non-optional HALs, grouped by name and sorted by name like the matrix.
+    const RequiredHals& getRequiredHals() const;
+    // Required HALs with the given name, in the order of the matrix. Only the HALs with this
+    // name are compiled, so checking a few names does not compile the whole matrix.
+    const std::vector<details::CompiledMatrixHal>* getRequiredHals(const std::string& name) const;
+
+    // Kernel requirements for the given kernel version x.y, grouped by level.
+    const details::MatrixKernelsByLevel& getKernels(const Version& kernelVersion) const;
+    // Configs of the above. nullptr if there are no kernel requirements for kernelVersion.
+    const details::KernelConfigIndex* getKernelConfigIndex(const Version& kernelVersion) const;
+
+    // Kernel requirements with the same kernel version x.y.
+    struct SameVersionKernels {
+        std::vector<const MatrixKernel*> kernels;
+        details::MatrixKernelsByLevel byLevel;
+        // Built by getKernelConfigIndex on first use.
+        mutable std::once_flag configIndexOnce;
+        mutable std::optional<details::KernelConfigIndex> configIndex;
+    };
+
+    const std::map<Version, SameVersionKernels>& getSameVersionKernels() const;
+
+    const CompatibilityMatrix* mMatrix;
+    // Built by getRequiredHals on first use.
+    mutable std::once_flag mRequiredHalsOnce;
+    mutable RequiredHals mRequiredHals;
+    // Built by getRequiredHals(name) for each name on first use.
+    mutable std::mutex mRequiredHalsByNameMutex;
+    mutable std::map<std::string, std::vector<details::CompiledMatrixHal>, std::less<>>
+        mRequiredHalsByName;
+    // Built by getSameVersionKernels on first use.
+    mutable std::once_flag mKernelsOnce;
+    mutable std::map<Version, SameVersionKernels> mKernels;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_CHECK_PLAN_H
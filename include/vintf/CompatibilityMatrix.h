@@ -62,6 +62,17 @@ struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<Mat
 
     std::string getVendorNdkVersion() const;
 
+    // Combine a set of framework compatibility matrices for every device level that any of
+    // them declares, as combine() does for a single level. matrices are not modified.
+    // Levels are combined from the highest down: the result for a level is the matrices of
+    // that level plus the combined matrices of all higher levels as optional requirements,
+    // so each matrix is merged once and results share their HAL instance sets.
+    // A level that cannot be combined (e.g. conflict of information) maps to nullptr, and its
+    // error is set in errors if errors is not null; other levels are still combined.
+    static std::map<Level, std::unique_ptr<CompatibilityMatrix>> combineAllLevels(
+        const std::vector<Named<CompatibilityMatrix>>& matrices,
+        std::map<Level, std::string>* errors);
+
    protected:
     bool forEachInstanceOfVersion(
         HalFormat format, const std::string& package, const Version& expectVersion,
@@ -117,6 +128,13 @@ struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<Mat
     static std::unique_ptr<CompatibilityMatrix> combine(
         Level deviceLevel, std::vector<Named<CompatibilityMatrix>>* matrices, std::string* error);
 
+    // Same as combine() for matrices, which must all be of deviceLevel or of unspecified
+    // level, then add all requirements of higher as optional. higher is the combined matrix
+    // of all levels above deviceLevel, or nullptr if there are none.
+    static std::unique_ptr<CompatibilityMatrix> combineWithHigherLevels(
+        Level deviceLevel, std::vector<Named<CompatibilityMatrix>>* matrices,
+        const CompatibilityMatrix* higher, std::string* error);
+
     // Combine a set of device compatibility matrices.
     static std::unique_ptr<CompatibilityMatrix> combineDeviceMatrices(
         std::vector<Named<CompatibilityMatrix>>* matrices, std::string* error);
@@ -144,6 +162,8 @@ struct CompatibilityMatrix : public HalGroup<MatrixHal>, public XmlFileGroup<Mat
     friend struct DeviceCompatibilityMatrixCombineTest;
     friend class VintfObject;
     friend class AssembleVintfImpl;
+    friend class CheckPlan;
+    friend class CompatibilityReport;
     friend class KernelInfo;
     friend bool operator==(const CompatibilityMatrix &, const CompatibilityMatrix &);
 
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_COMPATIBILITY_REPORT_H
+#define ANDROID_VINTF_COMPATIBILITY_REPORT_H
+
+#include <string>
+#include <vector>
+
+#include "Level.h"
+#include "MatrixKernel.h"
+
+namespace android {
+namespace vintf {
+
+struct CompatibilityMatrix;
+struct HalManifest;
+struct KernelInfo;
+struct ManifestHal;
+struct MatrixHal;
+struct RuntimeInfo;
+
+// A reason why a HalManifest or RuntimeInfo is not compatible with a CompatibilityMatrix.
+// Pointers refer to the checked objects; they are valid as long as those objects are alive
+// and not modified.
+struct CompatibilityIssue {
+    enum class Type {
+        // The manifest or runtime info is checked against a matrix of the wrong type.
+        WRONG_TYPE,
+        // A required HAL is not in the manifest. See matrixHal.
+        HAL_MISSING,
+        // The manifest provides a required HAL, but none of its versions satisfies the
+        // matrix. See matrixHal and manifestHals.
+        HAL_VERSION,
+        // The manifest provides a required HAL in a satisfying version, but not all required
+        // instances. See matrixHal and manifestHals.
+        HAL_INSTANCE,
+        // The VNDK version required by the device matrix is not in the framework manifest.
+        VENDOR_NDK_VERSION,
+        // The framework manifest provides the VNDK version but not some of the libraries.
+        // See missing.
+        VENDOR_NDK_LIBRARIES,
+        // Some System SDK versions are not supported by the framework manifest. See missing.
+        SYSTEM_SDK,
+        // The sepolicy version of the device manifest does not satisfy the framework matrix.
+        SEPOLICY,
+        // The kernel sepolicy version of the runtime info is too low.
+        KERNEL_SEPOLICY,
+        // No kernel requirement in the matrix applies to the version and the kernel FCM
+        // version of the kernel. See kernel and kernelLevel.
+        KERNEL_VERSION,
+        // A kernel requirement applies, but the kernel does not satisfy one of its configs
+        // or conditions. See kernel, kernelLevel, kernelConfig and kernelConfigValue.
+        KERNEL_CONFIG,
+        // The AVB version of boot does not match the framework matrix.
+        AVB,
+        // The AVB version of vbmeta does not match the framework matrix.
+        VBMETA_AVB,
+    };
+
+    bool isHal() const {
+        return type == Type::HAL_MISSING || type == Type::HAL_VERSION ||
+               type == Type::HAL_INSTANCE;
+    }
+    bool isKernel() const {
+        return type == Type::KERNEL_VERSION || type == Type::KERNEL_CONFIG;
+    }
+
+    Type type;
+    // For HAL_*, the required HAL.
+    const MatrixHal* matrixHal = nullptr;
+    // For HAL_*, HALs in the manifest with the same name as matrixHal.
+    std::vector<const ManifestHal*> manifestHals;
+    // For VENDOR_NDK_LIBRARIES and SYSTEM_SDK, required names that are not provided.
+    std::vector<std::string> missing;
+    // For KERNEL_*, the checked kernel and its kernel FCM version.
+    const KernelInfo* kernel = nullptr;
+    Level kernelLevel = Level::UNSPECIFIED;
+    // For KERNEL_CONFIG, the unmet config or condition in the matrix, with the required value.
+    const KernelConfig* kernelConfig = nullptr;
+    // For KERNEL_CONFIG, the value of the config in the kernel, or nullptr if it is not set.
+    const std::string* kernelConfigValue = nullptr;
+
+    // A KERNEL_CONFIG issue if unmetConfig is not nullptr, otherwise KERNEL_VERSION.
+    static CompatibilityIssue ForKernel(const KernelInfo& kernel, Level kernelLevel,
+                                        const KernelConfig* unmetConfig);
+};
+
+// Result of getCompatibilityReport. Issues are stored with references to the checked objects
+// and are only formatted when toString() is called.
+// Like the error message, only the first incompatible part is reported; for HALs, all
+// incompatible HALs are reported.
+class CompatibilityReport {
+   public:
+    bool empty() const { return mIssues.empty(); }
+    const std::vector<CompatibilityIssue>& issues() const { return mIssues; }
+
+    // Format the issues as the error message of checkCompatibility.
+    std::string toString() const;
+
+   private:
+    friend struct HalManifest;
+    friend struct RuntimeInfo;
+
+    std::string toString(const CompatibilityIssue& issue) const;
+
+    const HalManifest* mManifest = nullptr;
+    const RuntimeInfo* mRuntimeInfo = nullptr;
+    const CompatibilityMatrix* mMatrix = nullptr;
+    std::vector<CompatibilityIssue> mIssues;
+};
+
+} // namespace vintf
+} // namespace android
+
+#endif // ANDROID_VINTF_COMPATIBILITY_REPORT_H
@@ -17,6 +17,8 @@
 #ifndef ANDROID_VINTF_FILE_SYSTEM_H
 #define ANDROID_VINTF_FILE_SYSTEM_H
 
+#include <stdint.h>
+
 #include <memory>
 #include <mutex>
 #include <string>
@@ -27,6 +29,14 @@
 namespace android {
 namespace vintf {
 
+// Identifies a version of a file or directory without reading it. If any field differs,
+// the file (or the list of files in the directory) may have changed.
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t inode = 0;
+};
+
 // Queries the file system in the correct way. Files can come from
 // an actual file system, a sub-directory, or from ADB, depending on the
 // implementation.
@@ -43,6 +53,13 @@ class FileSystem {
     //        OK if file names are retrieved and written to out.
     virtual status_t listFiles(const std::string& path, std::vector<std::string>* out,
                                std::string* error) const = 0;
+    // Return NAME_NOT_FOUND if file or directory is not found,
+    //        INVALID_OPERATION if not supported by this file system,
+    //        OK if the stat of path is written to out.
+    virtual status_t getStat(const std::string& /* path */, FileStat* /* out */,
+                             std::string* /* error */) const {
+        return INVALID_OPERATION;
+    }
 };
 
 namespace details {
@@ -52,6 +69,7 @@ class FileSystemImpl : public FileSystem {
    public:
     status_t fetch(const std::string&, std::string*, std::string*) const;
     status_t listFiles(const std::string&, std::vector<std::string>*, std::string*) const;
+    status_t getStat(const std::string&, FileStat*, std::string*) const;
 };
 
 // Class that does nothing.
@@ -69,6 +87,8 @@ class FileSystemUnderPath : public FileSystem {
                            std::string* error) const override;
     virtual status_t listFiles(const std::string& path, std::vector<std::string>* out,
                                std::string* error) const override;
+    virtual status_t getStat(const std::string& path, FileStat* out,
+                             std::string* error) const override;
 
    protected:
     const std::string& getRootDir() const;
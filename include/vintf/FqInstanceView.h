@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_FQ_INSTANCE_VIEW_H
+#define ANDROID_VINTF_FQ_INSTANCE_VIEW_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include <hidl-util/FqInstance.h>
+
+#include "Version.h"
+
+namespace android {
+namespace vintf {
+namespace details {
+
+// A non-owning view of a fully-qualified instance, e.g. android.hardware.foo@1.0::IFoo/default.
+// Used for internal traversal and comparison so that the components are not copied or
+// re-validated. The referenced strings must outlive the view. Convert to FqInstance with
+// toFqInstance() only when an owning object is needed.
+struct FqInstanceView {
+    std::string_view package;
+    Version version;
+    std::string_view interface;
+    std::string_view instance;
+
+    static FqInstanceView from(const FqInstance& e) {
+        return FqInstanceView{e.getPackage(), e.getVersion(), e.getInterface(), e.getInstance()};
+    }
+
+    bool toFqInstance(FqInstance* out) const {
+        return out->setTo(std::string(package), version.majorVer, version.minorVer,
+                          std::string(interface), std::string(instance));
+    }
+};
+
+inline bool operator==(const FqInstanceView& lft, const FqInstanceView& rgt) {
+    return std::tie(lft.package, lft.version, lft.interface, lft.instance) ==
+           std::tie(rgt.package, rgt.version, rgt.interface, rgt.instance);
+}
+inline bool operator!=(const FqInstanceView& lft, const FqInstanceView& rgt) {
+    return !(lft == rgt);
+}
+inline bool operator<(const FqInstanceView& lft, const FqInstanceView& rgt) {
+    return std::tie(lft.package, lft.version, lft.interface, lft.instance) <
+           std::tie(rgt.package, rgt.version, rgt.interface, rgt.instance);
+}
+
+// An index of instances provided by a single HAL, used to check the HAL against a
+// MatrixHal without comparing every required instance to every provided instance.
+// Maps (major version, interface, instance) to the highest provided minor version.
+// The referenced strings must outlive the index.
+class FqInstanceIndex {
+   public:
+    void insert(const FqInstanceView& view) {
+        auto [it, inserted] = mMaxMinor.emplace(
+            std::make_tuple(view.version.majorVer, view.interface, view.instance),
+            view.version.minorVer);
+        if (!inserted && it->second < view.version.minorVer) {
+            it->second = view.version.minorVer;
+        }
+    }
+
+    bool empty() const { return mMaxMinor.empty(); }
+
+    // Return true if @majorVer.(minMinor or above)::interface/instance is provided.
+    bool contains(size_t majorVer, size_t minMinor, std::string_view interface,
+                  std::string_view instance) const {
+        auto it = mMaxMinor.find(std::make_tuple(majorVer, interface, instance));
+        return it != mMaxMinor.end() && it->second >= minMinor;
+    }
+
+    // Return true if pred returns true for any instance of
+    // @majorVer.(minMinor or above)::interface.
+    bool anyInstanceOf(size_t majorVer, size_t minMinor, std::string_view interface,
+                       const std::function<bool(std::string_view)>& pred) const {
+        for (auto it = mMaxMinor.lower_bound(std::make_tuple(majorVer, interface, ""));
+             it != mMaxMinor.end() && std::get<0>(it->first) == majorVer &&
+             std::get<1>(it->first) == interface;
+             ++it) {
+            if (it->second >= minMinor && pred(std::get<2>(it->first))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    std::map<std::tuple<size_t, std::string_view, std::string_view>, size_t> mMaxMinor;
+};
+
+}  // namespace details
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_FQ_INSTANCE_VIEW_H
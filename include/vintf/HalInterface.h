@@ -18,6 +18,7 @@
 #define ANDROID_VINTF_HAL_INTERFACE_H_
 
 #include <functional>
+#include <memory>
 #include <set>
 #include <string>
 
@@ -28,17 +29,21 @@ namespace vintf {
 
 // manifest.hal.interface element / compatibility-matrix.hal.interface element
 struct HalInterface {
-    HalInterface() = default;
-    HalInterface(std::string&& name, std::set<std::string>&& instances)
-        : mName(std::move(name)), mInstances(std::move(instances)) {}
-    HalInterface(const std::string& name, const std::set<std::string>& instances)
-        : mName(name), mInstances(instances) {}
+    HalInterface();
+    HalInterface(std::string&& name, std::set<std::string>&& instances);
+    HalInterface(const std::string& name, const std::set<std::string>& instances);
 
     bool forEachInstance(
         const std::function<bool(const std::string& interface, const std::string& instance,
                                  bool isRegex)>& func) const;
     bool hasAnyInstance() const;
 
+    // Return true if instanceOrPattern is an <instance> (or a <regex-instance> if isRegex).
+    bool hasInstance(const std::string& instanceOrPattern, bool isRegex) const;
+
+    // Return number of <instance>s and <regex-instance>s.
+    size_t instancesCount() const { return mInstances->size() + mRegexes->size(); }
+
     // Return true if inserted, false otherwise.
     bool insertInstance(const std::string& instanceOrPattern, bool isRegex);
 
@@ -47,13 +52,32 @@ struct HalInterface {
 
     const std::string& name() const { return mName; }
 
+    // Set of instances. Sets with the same content are shared between all HalInterface
+    // objects that are constructed or parsed with it. The first mutation copies the set
+    // into one that is private to this object (copy-on-write); later mutations modify the
+    // private set in place until this object is copied.
+    using InstanceSet = std::shared_ptr<const std::set<std::string>>;
+
    private:
     friend bool operator==(const HalInterface&, const HalInterface&);
     friend struct HalInterfaceConverter;
+    friend struct LibVintfTest;
+
+    // Return the shared set with the same content as instances.
+    static InstanceSet intern(std::set<std::string>&& instances);
+
+    // Replace both sets with shared ones.
+    void setInstances(std::set<std::string>&& instances, std::set<std::string>&& regexes);
+
+    // Return the set that isRegex refers to, after making it private to this object.
+    std::set<std::string>* mutableInstances(bool isRegex);
 
     std::string mName;
-    std::set<std::string> mInstances;
-    std::set<std::string> mRegexes;
+    InstanceSet mInstances;
+    InstanceSet mRegexes;
+    // Whether mInstances / mRegexes are private sets that are not in the pool.
+    bool mInstancesPrivate = false;
+    bool mRegexesPrivate = false;
 };
 
 } // namespace vintf
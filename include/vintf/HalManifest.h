@@ -21,12 +21,14 @@
 #include <utils/Errors.h>
 #include <map>
 #include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
 #include <hidl/metadata.h>
 
 #include "CheckFlags.h"
+#include "CompatibilityReport.h"
 #include "FileSystem.h"
 #include "HalGroup.h"
 #include "KernelInfo.h"
@@ -34,6 +36,7 @@
 #include "ManifestHal.h"
 #include "ManifestInstance.h"
 #include "MapValueIterator.h"
+#include "Named.h"
 #include "SchemaType.h"
 #include "SystemSdk.h"
 #include "VendorNdk.h"
@@ -46,6 +49,16 @@ namespace vintf {
 
 struct MatrixHal;
 struct CompatibilityMatrix;
+class CheckPlan;
+class HidlInheritanceGraph;
+
+// Result of checking a device manifest against the framework matrix combined for a level.
+struct LevelCompatibility {
+    Level level = Level::UNSPECIFIED;
+    bool compatible = false;
+    // If not compatible, the first incompatibility found.
+    std::string error;
+};
 
 namespace details {
 using InstancesOfVersion =
@@ -77,8 +90,29 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
     // - device manifest vs. framework compat-mat
     //     - checkIncompatibility for HALs returns only optional HALs
     //     - manifest.sepolicy.version match one of compat-mat.sepolicy.sepolicy-version
+    // If error is nullptr, return at the first incompatibility without building any message.
     bool checkCompatibility(const CompatibilityMatrix& mat, std::string* error = nullptr,
                             CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    // Same as above, but against a matrix that is preprocessed for repeated checks.
+    bool checkCompatibility(const CheckPlan& plan, std::string* error = nullptr,
+                            CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    // Same as checkCompatibility, but describe the incompatibilities in report instead of an
+    // error message. Return whether this manifest is compatible.
+    bool getCompatibilityReport(const CompatibilityMatrix& mat, CompatibilityReport* report,
+                                CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    bool getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+
+    // Check this device manifest against the framework matrix combined from
+    // frameworkMatrices for each level they declare (see
+    // CompatibilityMatrix::combineAllLevels), in ascending order of level. Required HALs
+    // that are the same as in the previous level are not checked again.
+    // The highest compatible level is the highest level that this device could target.
+    // A level whose matrices cannot be combined is incompatible, with the reason in its error.
+    // Return an empty vector and set error if no matrix declares a level.
+    std::vector<LevelCompatibility> checkCompatibilityForAllLevels(
+        const std::vector<Named<CompatibilityMatrix>>& frameworkMatrices,
+        std::string* error = nullptr, CheckFlags::Type flags = CheckFlags::DEFAULT) const;
 
     // Generate a compatibility matrix such that checkCompatibility will return true.
     CompatibilityMatrix generateCompatibleMatrix() const;
@@ -153,6 +187,7 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
     friend struct HalManifestConverter;
     friend class VintfObject;
     friend class AssembleVintfImpl;
+    friend class CompatibilityReport;
     friend struct LibVintfTest;
     friend std::string dump(const HalManifest &vm);
     friend bool operator==(const HalManifest &lft, const HalManifest &rgt);
@@ -164,11 +199,19 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
     // Check if all instances in matrixHal is supported in this manifest.
     bool isCompatible(const details::Instances& instances, const MatrixHal& matrixHal) const;
 
-    // Return a list of error messages (for each <hal> name) that does NOT conform to
-    // the given compatibility matrix. It does not contain components that are optional.
-    // That is, return empty list iff
+    // Add an issue to report for each <hal> that does NOT conform to the given compatibility
+    // matrix. Optional components are skipped. If report is nullptr, stop at the first one.
+    // If halNames is not nullptr, only <hal>s with these names are checked.
+    // That is, return true iff
     // (instance in matrix) => (instance in manifest).
-    std::vector<std::string> checkIncompatibleHals(const CompatibilityMatrix& mat) const;
+    bool checkIncompatibleHals(const CheckPlan& plan, CompatibilityReport* report,
+                               const std::set<std::string>* halNames = nullptr) const;
+
+    // Same as getCompatibilityReport, but if halNames is not nullptr, only <hal>s with these
+    // names are checked. If report is nullptr, return at the first incompatibility found.
+    bool getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                CheckFlags::Type flags,
+                                const std::set<std::string>* halNames) const;
 
     void removeHals(const std::string& name, size_t majorVer);
 
@@ -180,6 +223,9 @@ struct HalManifest : public HalGroup<ManifestHal>, public XmlFileGroup<ManifestX
     std::set<std::string> checkUnusedHals(
         const CompatibilityMatrix& mat,
         const std::vector<HidlInterfaceMetadata>& hidlMetadata) const;
+    // Same as above, but use an inheritance graph built from hidlMetadata beforehand.
+    std::set<std::string> checkUnusedHals(const CompatibilityMatrix& mat,
+                                          const HidlInheritanceGraph& inheritance) const;
 
     // Check that manifest has no entries.
     bool empty() const;
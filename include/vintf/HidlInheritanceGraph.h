@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_HIDL_INHERITANCE_GRAPH_H
+#define ANDROID_VINTF_HIDL_INHERITANCE_GRAPH_H
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <hidl-util/FQName.h>
+#include <hidl/metadata.h>
+
+namespace android {
+namespace vintf {
+
+// Inheritance between HIDL interfaces, built once from HidlInterfaceMetadata for repeated
+// queries. Each fully-qualified interface name is interned as a node and parsed once.
+class HidlInheritanceGraph {
+   public:
+    using NodeId = size_t;
+
+    explicit HidlInheritanceGraph(const std::vector<HidlInterfaceMetadata>& hidlMetadata);
+
+    // Node of the given fully-qualified interface name, e.g. android.hardware.foo@1.0::IFoo.
+    std::optional<NodeId> find(const std::string& fqName) const;
+
+    // Name of the node as it appears in the metadata.
+    const std::string& name(NodeId node) const { return mNames[node]; }
+    // Parsed name of the node, or nullptr if name(node) is not a valid FQName.
+    const FQName* fqName(NodeId node) const;
+
+    // Interfaces that are listed as inheriting from node, in the order of the metadata.
+    const std::vector<NodeId>& children(NodeId node) const { return mChildren[node]; }
+    // Interfaces that inherit from node directly or indirectly, sorted by NodeId. Computed on
+    // each call by walking children(), so its cost is proportional to the result.
+    std::vector<NodeId> descendants(NodeId node) const;
+
+   private:
+    NodeId intern(const std::string& name);
+
+    std::map<std::string, NodeId, std::less<>> mIds;
+    std::vector<std::string> mNames;
+    std::vector<std::optional<FQName>> mFqNames;
+    std::vector<std::vector<NodeId>> mChildren;
+};
+
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_HIDL_INHERITANCE_GRAPH_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VINTF_KERNEL_CONFIG_INDEX_H
+#define ANDROID_VINTF_KERNEL_CONFIG_INDEX_H
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MatrixKernel.h"
+
+namespace android {
+namespace vintf {
+namespace details {
+
+// Kernel config requirements of a set of MatrixKernels, with config keys interned into
+// dense ids. Tristate requirements are stored as bitsets over the ids, so that they are
+// checked against a kernel with a few word-wise operations. Other requirements are
+// checked one by one. The MatrixKernels must outlive this object.
+class KernelConfigIndex {
+   public:
+    using Bits = std::vector<uint64_t>;
+
+    // One bit per config id for each tristate value. For a kernel, "no" also includes
+    // configs that are missing.
+    struct TristateBits {
+        Bits yes;
+        Bits module;
+        Bits no;
+    };
+
+    struct Requirement {
+        TristateBits tristates;
+        // Non-tristate requirements, in the order of the matrix.
+        std::vector<KernelConfig> others;
+    };
+
+    explicit KernelConfigIndex(const std::vector<const MatrixKernel*>& kernels);
+
+    // Return nullptr if kernel is not in the index.
+    const Requirement* conditions(const MatrixKernel* kernel) const;
+    const Requirement* configs(const MatrixKernel* kernel) const;
+
+    // Tristate values of kernelConfigs (see KernelInfo::configs()) for the indexed keys.
+    TristateBits getTristateBits(const std::map<std::string, std::string>& kernelConfigs) const;
+
+    // Whether the tristate requirements in required are satisfied by kernel.
+    static bool Matches(const TristateBits& required, const TristateBits& kernel);
+
+   private:
+    size_t getOrAddId(std::string_view key);
+    Requirement compile(const std::vector<KernelConfig>& configs);
+    TristateBits emptyBits() const;
+
+    // Keys point into the MatrixKernels.
+    std::unordered_map<std::string_view, size_t> mIds;
+    // (conditions, configs)
+    std::unordered_map<const MatrixKernel*, std::pair<Requirement, Requirement>> mRequirements;
+};
+
+}  // namespace details
+}  // namespace vintf
+}  // namespace android
+
+#endif  // ANDROID_VINTF_KERNEL_CONFIG_INDEX_H
@@ -25,6 +25,10 @@
 namespace android {
 namespace vintf {
 
+namespace details {
+class KernelConfigIndex;
+}  // namespace details
+
 using KernelConfigIntValue = int64_t;
 using KernelConfigRangeValue = std::pair<uint64_t, uint64_t>;
 
@@ -47,9 +51,11 @@ struct KernelConfigTypedValue {
 
 private:
     friend struct KernelConfigTypedValueConverter;
+    friend class details::KernelConfigIndex;
     friend std::ostream &operator<<(std::ostream &os, const KernelConfigTypedValue &kctv);
     friend bool parseKernelConfigValue(const std::string &s, KernelConfigTypedValue *kctv);
     friend bool parseKernelConfigTypedValue(const std::string& s, KernelConfigTypedValue* kctv);
+    friend bool parseKernelConfigDeviceValue(const std::string& s, KernelConfigTypedValue* kctv);
 
     std::string mStringValue;
     KernelConfigIntValue mIntegerValue;
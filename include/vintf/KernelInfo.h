@@ -17,9 +17,13 @@
 #pragma once
 
 #include <map>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "KernelConfigIndex.h"
 #include "MatrixKernel.h"
 #include "Version.h"
 
@@ -29,6 +33,10 @@ namespace vintf {
 namespace details {
 class MockRuntimeInfo;
 struct StaticRuntimeInfo;
+
+// Kernel requirements with the same kernel version x.y, grouped by source matrix level and
+// sorted by level. Within a level, requirements are in the order of the matrix.
+using MatrixKernelsByLevel = std::vector<std::pair<Level, std::vector<const MatrixKernel*>>>;
 }  // namespace details
 
 // KernelInfo includes kernel-specific information on a device.
@@ -48,9 +56,23 @@ class KernelInfo {
                             std::string* error = nullptr) const;
     // return vector of pointers to elements in "kernels" that this matches
     // kernel requirement specified.
+    // If nothing matches and unmetConfig is not nullptr, it is set to the first config
+    // or condition in "kernels" that is not met, or nullptr if no requirement applies to
+    // the version and level of this kernel.
     std::vector<const MatrixKernel*> getMatchedKernelRequirements(
         const std::vector<MatrixKernel>& kernels, Level kernelLevel,
-        std::string* error = nullptr) const;
+        std::string* error = nullptr, const KernelConfig** unmetConfig = nullptr) const;
+    // Same as above, but sameVersionKernels are the elements in "kernels" with the same
+    // x.y as this kernel, grouped by level, e.g. from a CheckPlan. If configIndex is not
+    // nullptr, it must index all of sameVersionKernels and is used to match configs.
+    std::vector<const MatrixKernel*> getMatchedKernelRequirements(
+        const details::MatrixKernelsByLevel& sameVersionKernels,
+        const details::KernelConfigIndex* configIndex, const std::vector<MatrixKernel>& kernels,
+        Level kernelLevel, std::string* error = nullptr,
+        const KernelConfig** unmetConfig = nullptr) const;
+    // Group kernel requirements by source matrix level.
+    static details::MatrixKernelsByLevel GroupByLevel(
+        const std::vector<const MatrixKernel*>& kernels);
     bool operator==(const KernelInfo& other) const;
 
     // Merge information from "other".
@@ -65,8 +87,37 @@ class KernelInfo {
     friend struct RuntimeInfoFetcher;
     friend struct RuntimeInfo;
 
+    // Typed values of mConfigs, keyed by the address of the value in mConfigs. Each value is
+    // parsed on first use; std::nullopt if it cannot be parsed as any type.
+    using ParsedConfigs =
+        std::unordered_map<const std::string*, std::optional<KernelConfigTypedValue>>;
+
+    // State of one getMatchedKernelRequirements call. It must be only used with this object,
+    // and mConfigs must not be modified in between.
+    struct MatchState {
+        ParsedConfigs parsedConfigs;
+        const details::KernelConfigIndex* configIndex = nullptr;
+        // Tristate values of mConfigs. Only valid if configIndex is not nullptr.
+        details::KernelConfigIndex::TristateBits tristateBits;
+        // If true, the first unmet config requirement is stored in unmetConfig.
+        bool findUnmetConfig = false;
+        const KernelConfig* unmetConfig = nullptr;
+    };
+
+    // Return the first config in matrixConfigs that this kernel does not match, or nullptr
+    // if all of them match. If parsedConfigs is not null, parsed values are looked up from
+    // and stored into it.
+    const KernelConfig* findUnmetConfig(const std::vector<KernelConfig>& matrixConfigs,
+                                        ParsedConfigs* parsedConfigs) const;
+    bool matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
+                            ParsedConfigs* parsedConfigs, std::string* error) const;
+    // Same as above, but check the compiled requirement first if it is not nullptr.
+    bool matchKernelConfigs(const std::vector<KernelConfig>& matrixConfigs,
+                            const details::KernelConfigIndex::Requirement* requirement,
+                            MatchState* state, std::string* error) const;
     std::vector<const MatrixKernel*> getMatchedKernelVersionAndConfigs(
-        const std::vector<const MatrixKernel*>& kernels, std::string* error) const;
+        const std::vector<const MatrixKernel*>& kernels, MatchState* state,
+        std::string* error) const;
 
     // x.y.z
     KernelVersion mVersion;
@@ -21,10 +21,12 @@
 #include <map>
 #include <set>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <hidl-util/FqInstance.h>
 
+#include "FqInstanceView.h"
 #include "HalFormat.h"
 #include "HalInterface.h"
 #include "ManifestInstance.h"
@@ -85,9 +87,16 @@ struct ManifestHal {
     // Return all versions mentioned by <version>s and <fqname>s.
     void appendAllVersions(std::set<Version>* ret) const;
 
+    // Similar to forEachInstance, but passes views into the strings owned by this HAL
+    // instead of constructing a ManifestInstance for each instance.
+    bool forEachInstanceView(const std::function<bool(const details::FqInstanceView&)>& func) const;
+
     bool mIsOverride = false;
     // Additional instances to <version> x <interface> x <instance>.
     std::set<ManifestInstance> mAdditionalInstances;
+    // Index into mAdditionalInstances: (major version, interface, instance) -> minor version.
+    // Used by insertInstance to find the instance to replace without a linear scan.
+    std::map<std::tuple<size_t, std::string, std::string>, size_t> mAdditionalInstancesIndex;
 
     // insert instances to mAdditionalInstances.
     // Existing instances will be ignored.
@@ -96,6 +105,11 @@ struct ManifestHal {
     bool insertInstance(const FqInstance& fqInstance, std::string* error = nullptr);
     bool insertInstances(const std::set<FqInstance>& fqInstances, std::string* error = nullptr);
 
+    // Erase the instance of this HAL with the given components and the current transport
+    // and format from mAdditionalInstances. Return true if erased.
+    bool eraseAdditionalInstance(size_t majorVer, size_t minorVer, const std::string& interface,
+                                 const std::string& instance);
+
     // Verify instance before inserting.
     bool verifyInstance(const FqInstance& fqInstance, std::string* error = nullptr) const;
 };
@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 
+#include "FqInstanceView.h"
 #include "HalFormat.h"
 #include "HalInterface.h"
 #include "MatrixInstance.h"
@@ -62,11 +63,6 @@ struct MatrixHal {
         const std::function<bool(const std::vector<VersionRange>&, const std::string&,
                                  const std::string& instanceOrPattern, bool isRegex)>& func) const;
 
-    bool isCompatible(const std::set<FqInstance>& providedInstances,
-                      const std::set<Version>& providedVersions) const;
-    bool isCompatible(const VersionRange& vr, const std::set<FqInstance>& providedInstances,
-                      const std::set<Version>& providedVersions) const;
-
     void setOptional(bool o);
     void insertVersionRanges(const std::vector<VersionRange>& other);
     // Return size of all interface/instance pairs.
@@ -74,8 +70,6 @@ struct MatrixHal {
     void insertInstance(const std::string& interface, const std::string& instance, bool isRegex);
     // Remove a specific interface/instances. Return true if removed, false otherwise.
     bool removeInstance(const std::string& interface, const std::string& instance, bool isRegex);
-    // Remove all <interface> tags.
-    void clearInstances();
 };
 
 } // namespace vintf
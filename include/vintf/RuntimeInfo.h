@@ -26,6 +26,7 @@
 #include <utils/Errors.h>
 
 #include "CheckFlags.h"
+#include "CompatibilityReport.h"
 #include "KernelInfo.h"
 #include "MatrixKernel.h"
 #include "Version.h"
@@ -37,6 +38,7 @@ namespace testing {
 class VintfObjectRuntimeInfoTest;
 }  // namespace testing
 
+class CheckPlan;
 struct CompatibilityMatrix;
 
 // Runtime Info sent to OTA server
@@ -79,6 +81,15 @@ struct RuntimeInfo {
     // - avb-vbmetaversion matches related sysprops
     bool checkCompatibility(const CompatibilityMatrix& mat, std::string* error = nullptr,
                             CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    // Same as above, but use kernel requirements already bucketed by plan.
+    bool checkCompatibility(const CheckPlan& plan, std::string* error = nullptr,
+                            CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    // Same as checkCompatibility, but describe the incompatibilities in report instead of an
+    // error message. Return whether this runtime info is compatible.
+    bool getCompatibilityReport(const CompatibilityMatrix& mat, CompatibilityReport* report,
+                                CheckFlags::Type flags = CheckFlags::DEFAULT) const;
+    bool getCompatibilityReport(const CheckPlan& plan, CompatibilityReport* report,
+                                CheckFlags::Type flags = CheckFlags::DEFAULT) const;
 
 
     using FetchFlags = uint32_t;
@@ -100,6 +111,17 @@ struct RuntimeInfo {
    protected:
     virtual status_t fetchAllInformation(FetchFlags flags);
 
+    // Set identity to a string that changes whenever the information fetched by
+    // fetchAllInformation(flags) may change, without fetching all of it (e.g. /proc/config.gz
+    // is not decompressed or parsed). KERNEL_FCM is ignored. Return an error if the identity
+    // cannot be determined.
+    virtual status_t fetchIdentity(FetchFlags flags, std::string* identity) const;
+
+    // If plan is not null, it must be created from mat. If report is nullptr, return at the
+    // first incompatibility found.
+    bool getCompatibilityReport(const CompatibilityMatrix& mat, const CheckPlan* plan,
+                                CompatibilityReport* report, CheckFlags::Type flags) const;
+
     void setKernelLevel(Level level);
 
     friend struct RuntimeInfoFetcher;
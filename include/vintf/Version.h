@@ -19,6 +19,7 @@
 #define ANDROID_VINTF_VERSION_H
 
 #include <stdint.h>
+#include <functional>
 #include <string>
 #include <utility>
 
@@ -64,6 +65,25 @@ struct Version {
     inline bool minorAtLeast(const Version& other) const {
         return majorVer == other.majorVer && minorVer >= other.minorVer;
     }
+
+    // Packed representation (majorVer << 32 | minorVer). Packed values order the same way
+    // as Versions. Components that do not fit in 32 bits (e.g. the fake AIDL version)
+    // saturate to UINT32_MAX, and fromPacked() maps them back to SIZE_MAX.
+    constexpr uint64_t packed() const {
+        return (static_cast<uint64_t>(packComponent(majorVer)) << 32) | packComponent(minorVer);
+    }
+    static constexpr Version fromPacked(uint64_t packed) {
+        return Version(unpackComponent(static_cast<uint32_t>(packed >> 32)),
+                       unpackComponent(static_cast<uint32_t>(packed)));
+    }
+
+   private:
+    static constexpr uint32_t packComponent(size_t v) {
+        return v >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(v);
+    }
+    static constexpr size_t unpackComponent(uint32_t v) {
+        return v == UINT32_MAX ? SIZE_MAX : static_cast<size_t>(v);
+    }
 };
 
 struct KernelVersion {
@@ -99,4 +119,13 @@ struct KernelVersion {
 } // namespace vintf
 } // namespace android
 
+namespace std {
+template <>
+struct hash<::android::vintf::Version> {
+    size_t operator()(const ::android::vintf::Version& v) const {
+        return std::hash<uint64_t>{}(v.packed());
+    }
+};
+}  // namespace std
+
 #endif // ANDROID_VINTF_VERSION_H
@@ -19,9 +19,11 @@
 #define ANDROID_VINTF_VERSION_RANGE_H
 
 #include <stdint.h>
+#include <algorithm>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "Version.h"
 
@@ -71,6 +73,50 @@ struct VersionRange {
     size_t maxMinor;
 };
 
+namespace details {
+
+// Batch helpers over a list of version ranges. Each range is tested with packed
+// comparisons and no early exit, so the loops stay branch-free and can be vectorized
+// by the compiler. Bit i of the returned mask is set if ranges[i] matches; only the
+// first 64 ranges are considered, which is far more than any HAL declares.
+inline uint64_t containsMask(const std::vector<VersionRange>& ranges, const Version& ver) {
+    const uint64_t v = ver.packed();
+    uint64_t mask = 0;
+    const size_t n = std::min<size_t>(ranges.size(), 64);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t hit = (ranges[i].minVer().packed() <= v) & (v <= ranges[i].maxVer().packed());
+        mask |= hit << i;
+    }
+    return mask;
+}
+
+inline uint64_t supportedByMask(const std::vector<VersionRange>& ranges, const Version& ver) {
+    const uint64_t v = ver.packed();
+    uint64_t mask = 0;
+    const size_t n = std::min<size_t>(ranges.size(), 64);
+    for (size_t i = 0; i < n; ++i) {
+        // Same major version and minMinor <= ver.minorVer.
+        uint64_t hit = ((ranges[i].minVer().packed() ^ v) >> 32 == 0) &
+                       (ranges[i].minVer().packed() <= v);
+        mask |= hit << i;
+    }
+    return mask;
+}
+
+inline bool anyContains(const std::vector<VersionRange>& ranges, const Version& ver) {
+    if (ranges.size() <= 64) return containsMask(ranges, ver) != 0;
+    return std::any_of(ranges.begin(), ranges.end(),
+                       [&](const auto& vr) { return vr.contains(ver); });
+}
+
+inline bool anySupportedBy(const std::vector<VersionRange>& ranges, const Version& ver) {
+    if (ranges.size() <= 64) return supportedByMask(ranges, ver) != 0;
+    return std::any_of(ranges.begin(), ranges.end(),
+                       [&](const auto& vr) { return vr.supportedBy(ver); });
+}
+
+}  // namespace details
+
 } // namespace vintf
 } // namespace android
 
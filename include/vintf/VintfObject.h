@@ -17,9 +17,12 @@
 #ifndef ANDROID_VINTF_VINTF_OBJECT_H_
 #define ANDROID_VINTF_VINTF_OBJECT_H_
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -31,6 +34,7 @@
 #include "CompatibilityMatrix.h"
 #include "FileSystem.h"
 #include "HalManifest.h"
+#include "HidlInheritanceGraph.h"
 #include "Level.h"
 #include "Named.h"
 #include "ObjectFactory.h"
@@ -40,7 +44,11 @@
 namespace android {
 namespace vintf {
 
+class CheckPlan;
+
 namespace details {
+class CompatibilityCache;
+class ObjectCache;
 class VintfObjectAfterUpdate;
 
 template <typename T>
@@ -55,6 +63,49 @@ struct LockedRuntimeInfoCache {
     std::mutex mutex;
     RuntimeInfo::FetchFlags fetchedFlags = RuntimeInfo::FetchFlag::NONE;
 };
+
+// Files merged into an assembled HalManifest, in the order they are merged.
+using ManifestSources = std::vector<std::pair<std::string, HalManifest>>;
+
+// Result of checking the HALs of a HalManifest against a CompatibilityMatrix.
+struct HalCheckMemo {
+    std::mutex mutex;
+    std::shared_ptr<const HalManifest> manifest;
+    std::shared_ptr<const CompatibilityMatrix> matrix;
+    // Names of required HALs in matrix that are not satisfied by manifest.
+    std::set<std::string> incompatibleHals;
+    // Names of HALs that are changed in manifest since incompatibleHals is computed.
+    std::set<std::string> changedHals;
+};
+
+// Parsed framework matrix fragments, shared by all users of a VintfObject and by the
+// VintfObjects it is the framework source of (see VintfObject::Builder::setFrameworkSource).
+// The fragments are immutable once fetched; nullptr if not fetched.
+struct FrameworkMatrixLevelsCache {
+    std::mutex mutex;
+    std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>> levels;
+};
+
+// CheckPlan of the matrix that is last checked against.
+struct CheckPlanCache {
+    std::mutex mutex;
+    std::shared_ptr<const CompatibilityMatrix> matrix;
+    std::shared_ptr<const CheckPlan> plan;
+};
+
+// Results of VintfObject::checkCompatibility for each CheckFlags value.
+struct CheckResultMemo {
+    struct Result {
+        // Generation of the cached objects that the result is computed from.
+        uint64_t generation;
+        int32_t status;
+        // Whether the error message was requested. If not, error is empty.
+        bool hasError;
+        std::string error;
+    };
+    std::mutex mutex;
+    std::map<int32_t /* CheckFlags::Type::value() */, Result> results;
+};
 }  // namespace details
 
 namespace testing {
@@ -87,7 +138,7 @@ class VintfObjectCompatibleTest;
  */
 class VintfObject {
    public:
-    virtual ~VintfObject() = default;
+    virtual ~VintfObject();
 
     /*
      * Return the API that access the device-side HAL manifests built from component pieces on the
@@ -134,12 +185,37 @@ class VintfObject {
     std::shared_ptr<const RuntimeInfo> getRuntimeInfo(
         bool skipCache = false, RuntimeInfo::FetchFlags flags = RuntimeInfo::FetchFlag::ALL);
 
+    /**
+     * Check compatibility on the device after the manifest fragment at the given path has
+     * changed.
+     *
+     * If incremental checks are enabled (see Builder::setIncrementalChecks), only the <hal>s
+     * named in the old or new fragment are merged into the device or framework manifest again,
+     * and only requirements on these HALs are checked again. Otherwise, or if the fragment is
+     * new or changes anything other than <hal>s, all manifests and matrices are read and
+     * checked again.
+     *
+     * Return values are the same as checkCompatibility.
+     */
+    int32_t recheckCompatibility(const std::string& fragmentPath, std::string* error = nullptr,
+                                 CheckFlags::Type flags = CheckFlags::DEFAULT);
+
     /**
      * Check compatibility on the device.
      *
-     * @param error error message
+     * @param error error message. If nullptr, the checks stop at the first incompatibility
+     *              and no message is built. Call again with an error string to get the
+     *              reason.
      * @param flags flags to disable certain checks. See CheckFlags.
      *
+     * Results are memoized for each value of flags, so repeated calls return immediately
+     * until any cached object is fetched again (e.g. with skipCache, or RuntimeInfo with
+     * other FetchFlags) or the manifests are re-merged by recheckCompatibility.
+     *
+     * If a compatibility cache is set (see Builder::setCompatibilityCache), the stored
+     * result and error message are returned if none of the inputs changed since they were
+     * stored.
+     *
      * @return = 0 if success (compatible)
      *         > 0 if incompatible
      *         < 0 if any error (mount partition fails, illformed XML, etc.)
@@ -147,6 +223,19 @@ class VintfObject {
     int32_t checkCompatibility(std::string* error = nullptr,
                                CheckFlags::Type flags = CheckFlags::DEFAULT);
 
+    /**
+     * Check compatibility of each of the given objects, e.g. many device images against the
+     * same framework image, on up to numThreads threads. Each object is only used by one
+     * thread. Build the objects with the same Builder::setFrameworkSource so that the
+     * framework side is read and parsed once for all of them.
+     *
+     * @return return value and error message of checkCompatibility for each object, in the
+     *         same order as objects.
+     */
+    static std::vector<std::pair<int32_t, std::string>> CheckCompatibilityForAll(
+        const std::vector<VintfObject*>& objects, size_t numThreads,
+        CheckFlags::Type flags = CheckFlags::DEFAULT);
+
     /**
      * A std::function that abstracts a list of "provided" instance names. Given package, version
      * and interface, the function returns a list of instance names that matches.
@@ -160,6 +249,16 @@ class VintfObject {
     using ListInstances = std::function<std::vector<std::pair<std::string, Version>>(
         const std::string& package, Version version, const std::string& interface,
         const std::vector<std::string>& hintInstances)>;
+
+    /**
+     * Return a ListInstances that calls listInstances at most once for the same arguments.
+     * Results are kept for as long as the returned function (or a copy of it) is alive, so
+     * it should not outlive the state listInstances reflects, e.g. the set of running
+     * services. The returned function is thread-safe if listInstances is.
+     *
+     * checkDeprecation always memoizes listInstances for the duration of the call.
+     */
+    static ListInstances MemoizeListInstances(ListInstances listInstances);
     /**
      * Check deprecation on framework matrices with a provided predicate.
      *
@@ -175,6 +274,13 @@ class VintfObject {
     int32_t checkDeprecation(const ListInstances& listInstances,
                              const std::vector<HidlInterfaceMetadata>& hidlMetadata,
                              std::string* error = nullptr);
+    // Same as above, but use an inheritance graph built from the HIDL metadata beforehand.
+    // If listInstancesIsThreadSafe, HALs in old matrices are checked on worker threads;
+    // the result and error message are the same.
+    int32_t checkDeprecation(const ListInstances& listInstances,
+                             const HidlInheritanceGraph& inheritance,
+                             std::string* error = nullptr,
+                             bool listInstancesIsThreadSafe = false);
 
     /**
      * Check deprecation on existing VINTF metadata. Use Device Manifest as the
@@ -186,6 +292,8 @@ class VintfObject {
      */
     int32_t checkDeprecation(const std::vector<HidlInterfaceMetadata>& hidlMetadata,
                              std::string* error = nullptr);
+    int32_t checkDeprecation(const HidlInheritanceGraph& inheritance,
+                             std::string* error = nullptr);
 
     /**
      * Return kernel FCM version.
@@ -223,6 +331,7 @@ class VintfObject {
      */
     android::base::Result<void> checkUnusedHals(
         const std::vector<HidlInterfaceMetadata>& hidlMetadata);
+    android::base::Result<void> checkUnusedHals(const HidlInheritanceGraph& inheritance);
 
    private:
     std::unique_ptr<FileSystem> mFileSystem;
@@ -241,6 +350,30 @@ class VintfObject {
 
     details::LockedRuntimeInfoCache mDeviceRuntimeInfo;
 
+    std::unique_ptr<details::CompatibilityCache> mCompatibilityCache;
+    std::unique_ptr<details::ObjectCache> mObjectCache;
+    bool mConcurrentChecks = false;
+
+    // Only used if incremental checks are enabled. Sources are guarded by the mutex of the
+    // corresponding manifest.
+    bool mIncrementalChecks = false;
+    details::ManifestSources mDeviceManifestSources;
+    details::ManifestSources mFrameworkManifestSources;
+    details::HalCheckMemo mDeviceManifestCheck;     // against framework matrix
+    details::HalCheckMemo mFrameworkManifestCheck;  // against device matrix
+
+    details::CheckPlanCache mFrameworkMatrixPlan;
+    details::CheckPlanCache mDeviceMatrixPlan;
+
+    std::atomic<uint64_t> mGeneration{0};
+    details::CheckResultMemo mCheckResults;
+
+    // Cleared when the framework matrix is fetched again.
+    details::FrameworkMatrixLevelsCache mFrameworkMatrixLevels;
+
+    // If set, the framework manifest and framework matrix fragments are read through it.
+    std::shared_ptr<VintfObject> mFrameworkSource;
+
     // Expose functions for testing and recovery
     friend class testing::VintfObjectTestBase;
     friend class testing::VintfObjectRuntimeInfoTest;
@@ -306,36 +439,69 @@ class VintfObject {
         bool skipCache = false, RuntimeInfo::FetchFlags flags = RuntimeInfo::FetchFlag::ALL);
 
    private:
+    int32_t checkCompatibilityUnmemoized(std::string* error, CheckFlags::Type flags);
+    // See RuntimeInfo::fetchIdentity.
+    status_t getRuntimeInfoIdentity(std::string* identity);
+    int32_t checkCompatibilityInternal(std::string* error, CheckFlags::Type flags);
+    // The generation of the cached objects, including those of the framework source. It
+    // changes whenever a cached object is fetched again.
+    uint64_t getGeneration() const;
+    // Invalidate memoized results of checkCompatibility. Call after a cached object is
+    // fetched again or modified.
+    void bumpGeneration();
+    static std::shared_ptr<const CheckPlan> GetCheckPlan(
+        const std::shared_ptr<const CompatibilityMatrix>& matrix, details::CheckPlanCache* cache);
+    static bool CheckManifest(const std::shared_ptr<const HalManifest>& manifest,
+                              const std::shared_ptr<const CompatibilityMatrix>& matrix,
+                              const CheckPlan& plan, details::HalCheckMemo* memo,
+                              std::string* error);
+    status_t remergeManifestFragment(const std::string& path,
+                                     details::LockedSharedPtr<HalManifest>* ptr,
+                                     details::ManifestSources* sources,
+                                     details::HalCheckMemo* memo, std::string* error);
     status_t getCombinedFrameworkMatrix(const std::shared_ptr<const HalManifest>& deviceManifest,
                                         CompatibilityMatrix* out, std::string* error = nullptr);
-    status_t getAllFrameworkMatrixLevels(std::vector<Named<CompatibilityMatrix>>* out,
-                                         std::string* error = nullptr);
+    // Parsed framework matrix fragments, read once and cached.
+    status_t getAllFrameworkMatrixLevels(
+        std::shared_ptr<const std::vector<Named<CompatibilityMatrix>>>* out,
+        std::string* error = nullptr);
+    // Read and parse all framework matrix fragments and append them to out.
+    status_t fetchAllFrameworkMatrixLevels(std::vector<Named<CompatibilityMatrix>>* out,
+                                           std::string* error = nullptr);
     status_t getOneMatrix(const std::string& path, Named<CompatibilityMatrix>* out,
                           std::string* error = nullptr);
+    // If sources is not nullptr, the files merged into the manifest are appended to it.
     status_t addDirectoryManifests(const std::string& directory, HalManifest* manifests,
-                                   std::string* error = nullptr);
-    status_t fetchDeviceHalManifest(HalManifest* out, std::string* error = nullptr);
+                                   std::string* error = nullptr,
+                                   details::ManifestSources* sources = nullptr);
+    status_t fetchDeviceHalManifest(HalManifest* out, std::string* error = nullptr,
+                                    details::ManifestSources* sources = nullptr);
     status_t fetchDeviceMatrix(CompatibilityMatrix* out, std::string* error = nullptr);
-    status_t fetchOdmHalManifest(HalManifest* out, std::string* error = nullptr);
+    status_t fetchOdmHalManifest(HalManifest* out, std::string* error = nullptr,
+                                 details::ManifestSources* sources = nullptr);
     status_t fetchOneHalManifest(const std::string& path, HalManifest* out,
-                                 std::string* error = nullptr);
-    status_t fetchVendorHalManifest(HalManifest* out, std::string* error = nullptr);
-    status_t fetchFrameworkHalManifest(HalManifest* out, std::string* error = nullptr);
+                                 std::string* error = nullptr,
+                                 details::ManifestSources* sources = nullptr);
+    status_t fetchVendorHalManifest(HalManifest* out, std::string* error = nullptr,
+                                    details::ManifestSources* sources = nullptr);
+    status_t fetchFrameworkHalManifest(HalManifest* out, std::string* error = nullptr,
+                                       details::ManifestSources* sources = nullptr);
 
-    using ChildrenMap = std::multimap<std::string, std::string>;
     static bool IsHalDeprecated(const MatrixHal& oldMatrixHal,
                                 const CompatibilityMatrix& targetMatrix,
-                                const ListInstances& listInstances, const ChildrenMap& childrenMap,
+                                const ListInstances& listInstances,
+                                const HidlInheritanceGraph& inheritance,
                                 std::string* appendedError);
     static bool IsInstanceDeprecated(const MatrixInstance& oldMatrixInstance,
                                      const CompatibilityMatrix& targetMatrix,
                                      const ListInstances& listInstances,
-                                     const ChildrenMap& childrenMap, std::string* appendedError);
+                                     const HidlInheritanceGraph& inheritance,
+                                     std::string* appendedError);
 
     static android::base::Result<std::vector<FqInstance>> GetListedInstanceInheritance(
         const std::string& package, const Version& version, const std::string& interface,
         const std::string& instance, const ListInstances& listInstances,
-        const ChildrenMap& childrenMap);
+        const HidlInheritanceGraph& inheritance);
     static bool IsInstanceListed(const ListInstances& listInstances, const FqInstance& fqInstance);
     static android::base::Result<void> IsFqInstanceDeprecated(
         const CompatibilityMatrix& targetMatrix, HalFormat format, const FqInstance& fqInstance,
@@ -354,10 +520,39 @@ class VintfObject {
         Builder& setFileSystem(std::unique_ptr<FileSystem>&&);
         Builder& setRuntimeInfoFactory(std::unique_ptr<ObjectFactory<RuntimeInfo>>&&);
         Builder& setPropertyFetcher(std::unique_ptr<PropertyFetcher>&&);
+        // If true, checkCompatibility fetches the manifests, matrices and RuntimeInfo and runs
+        // the checks on worker threads, manifest fragments in a directory are fetched and
+        // parsed on worker threads, and checkDeprecation against the device manifest checks
+        // HALs on worker threads. The result and error message are the same as in the default
+        // sequential mode.
+        Builder& setConcurrentChecks(bool concurrent);
+        // If true, remember the manifest files and the result of checking each HAL so that
+        // recheckCompatibility only merges and checks the HALs in the changed fragment.
+        Builder& setIncrementalChecks(bool incremental);
+        // Opt in to an on-disk cache of the result of checkCompatibility at the given path.
+        // Files and properties read by the VintfObject are recorded, and a stored result is
+        // only used if all of them, the check flags and the RuntimeInfo are unchanged.
+        Builder& setCompatibilityCache(const std::string& path);
+        // Opt in to an on-disk cache of the device and framework manifests and matrices at
+        // the given path, so that processes load each of them from one file instead of
+        // fetching, parsing and merging all fragments. A stored object is only used if all
+        // files (compared by size, modification time and inode where the FileSystem supports
+        // it) and properties it was assembled from are unchanged. Not compatible with
+        // setIncrementalChecks, which needs the fragments.
+        Builder& setObjectCache(const std::string& path);
+        // Read the framework manifest and framework compatibility matrix fragments through
+        // framework instead of the FileSystem of this object. Objects built with the same
+        // framework share them, so they are only read and parsed once; the matrix fragments are
+        // kept for the lifetime of framework. Device manifests and matrices, and the framework
+        // matrix combined for the device, are still fetched by each object. Not compatible with
+        // setCompatibilityCache or setObjectCache, which cannot see files read by framework.
+        Builder& setFrameworkSource(std::shared_ptr<VintfObject> framework);
         std::unique_ptr<VintfObject> build();
 
        private:
         std::unique_ptr<VintfObject> mObject;
+        std::string mCompatibilityCachePath;
+        std::string mObjectCachePath;
     };
 
    private:
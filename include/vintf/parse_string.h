@@ -98,6 +98,11 @@ bool parseKernelConfigValue(const std::string &s, KernelConfigTypedValue *kctv);
 // Do not expect quotes in strings.
 bool parseKernelConfigTypedValue(const std::string& s, KernelConfigTypedValue* kctv);
 
+// Parse a kernel config value as it appears in /proc/config.gz (type is guessed, including
+// ranges) and store it in kctv. Strings must be quoted. The possible types are disjoint, so
+// a value matches a requirement iff the parsed value is equal to the requirement.
+bool parseKernelConfigDeviceValue(const std::string& s, KernelConfigTypedValue* kctv);
+
 // A string that describes the whole object, with versions of all
 // its components. For debugging and testing purposes only. This is not
 // the XML string.
@@ -213,6 +213,17 @@ bool parseKernelConfigTypedValue(const std::string& s, KernelConfigTypedValue* k
     return false;
 }
 
+bool parseKernelConfigDeviceValue(const std::string& s, KernelConfigTypedValue* kctv) {
+    if (parseKernelConfigTypedValue(s, kctv)) {
+        return true;
+    }
+    if (parseRange(s, &kctv->mRangeValue)) {
+        kctv->mType = KernelConfigType::RANGE;
+        return true;
+    }
+    return false;
+}
+
 bool parse(const std::string &s, Version *ver) {
     std::vector<std::string> v = SplitString(s, '.');
     if (v.size() != 2) {
@@ -507,8 +507,8 @@ struct HalInterfaceConverter : public XmlNodeConverter<HalInterface> {
     std::string elementName() const override { return "interface"; }
     void mutateNode(const HalInterface &intf, NodeType *root, DocType *d) const override {
         appendTextElement(root, "name", intf.name(), d);
-        appendTextElements(root, "instance", intf.mInstances, d);
-        appendTextElements(root, "regex-instance", intf.mRegexes, d);
+        appendTextElements(root, "instance", *intf.mInstances, d);
+        appendTextElements(root, "regex-instance", *intf.mRegexes, d);
     }
     bool buildObject(HalInterface* intf, NodeType* root, std::string* error) const override {
         std::vector<std::string> instances;
@@ -519,8 +519,12 @@ struct HalInterfaceConverter : public XmlNodeConverter<HalInterface> {
             return false;
         }
         bool success = true;
+        // Build the sets locally and intern them once, instead of a copy-on-write
+        // per insertInstance().
+        std::set<std::string> instanceSet = *intf->mInstances;
+        std::set<std::string> regexSet = *intf->mRegexes;
         for (const auto& e : instances) {
-            if (!intf->insertInstance(e, false /* isRegex */)) {
+            if (!instanceSet.insert(e).second) {
                 if (!error->empty()) *error += "\n";
                 *error += "Duplicated instance '" + e + "' in " + intf->name();
                 success = false;
@@ -533,12 +537,13 @@ struct HalInterfaceConverter : public XmlNodeConverter<HalInterface> {
                 *error += "Invalid regular expression '" + e + "' in " + intf->name();
                 success = false;
             }
-            if (!intf->insertInstance(e, true /* isRegex */)) {
+            if (!regexSet.insert(e).second) {
                 if (!error->empty()) *error += "\n";
                 *error += "Duplicated regex-instance '" + e + "' in " + intf->name();
                 success = false;
             }
         }
+        intf->setInstances(std::move(instanceSet), std::move(regexSet));
         return success;
     }
 };
@@ -18,13 +18,16 @@
 
 #include <algorithm>
 #include <functional>
+#include <thread>
 
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
 #include <gtest/gtest.h>
 
+#include <vintf/CheckPlan.h>
 #include <vintf/CompatibilityMatrix.h>
+#include <vintf/HidlInheritanceGraph.h>
 #include <vintf/KernelConfigParser.h>
 #include <vintf/VintfObject.h>
 #include <vintf/parse_string.h>
@@ -70,6 +73,9 @@ public:
     bool add(HalManifest &vm, ManifestHal &&hal) {
         return vm.add(std::move(hal));
     }
+    const HalInterface::InstanceSet& getInstances(const HalInterface& intf) {
+        return intf.mInstances;
+    }
     void addXmlFile(CompatibilityMatrix& cm, std::string name, VersionRange range) {
         MatrixXmlFile f;
         f.mName = name;
@@ -88,6 +94,9 @@ public:
         cm.device.mVndk.mVersionRange = range;
         cm.device.mVndk.mLibraries = libs;
     }
+    void addKernelConfig(KernelInfo& ki, const std::string& key, const std::string& value) {
+        ki.mConfigs.emplace(key, value);
+    }
     void setAvb(RuntimeInfo &ki, Version vbmeta, Version boot) {
         ki.mBootVbmetaAvbVersion = vbmeta;
         ki.mBootAvbVersion = boot;
@@ -117,6 +126,23 @@ public:
         return mh.isValid();
     }
     std::vector<MatrixKernel>& getKernels(CompatibilityMatrix& cm) { return cm.framework.mKernels; }
+    // Match ki against kernels, which must have the same x.y, with and without a
+    // KernelConfigIndex, and expect the same result and error from both.
+    bool matchKernels(const KernelInfo& ki, const std::vector<MatrixKernel>& kernels,
+                      std::string* error) {
+        bool matched = !ki.getMatchedKernelRequirements(kernels, Level::UNSPECIFIED, error).empty();
+        std::vector<const MatrixKernel*> sameVersionKernels;
+        for (const MatrixKernel& kernel : kernels) sameVersionKernels.push_back(&kernel);
+        details::KernelConfigIndex index(sameVersionKernels);
+        std::string indexError;
+        bool indexMatched = !ki.getMatchedKernelRequirements(
+                                   KernelInfo::GroupByLevel(sameVersionKernels), &index, kernels,
+                                   Level::UNSPECIFIED, &indexError)
+                                 .empty();
+        EXPECT_EQ(matched, indexMatched);
+        EXPECT_EQ(*error, indexError);
+        return matched;
+    }
     bool addAllHalsAsOptional(CompatibilityMatrix* cm1, CompatibilityMatrix* cm2, std::string* e) {
         return cm1->addAllHalsAsOptional(cm2, e);
     }
@@ -473,11 +499,130 @@ TEST_F(LibVintfTest, VersionConverter) {
     EXPECT_EQ(v, v2);
 }
 
+TEST_F(LibVintfTest, VersionPacked) {
+    EXPECT_EQ(Version(3, 6), Version::fromPacked(Version(3, 6).packed()));
+    EXPECT_EQ(details::kFakeAidlVersion, Version::fromPacked(details::kFakeAidlVersion.packed()));
+    EXPECT_LT(Version(1, 9).packed(), Version(2, 0).packed());
+    EXPECT_LT(Version(2, 0).packed(), Version(2, 1).packed());
+    EXPECT_EQ(std::hash<Version>{}(Version(2, 1)), std::hash<Version>{}(Version(2, 1)));
+
+    std::vector<VersionRange> ranges{{1, 2, 3}, {2, 0, 4}, {2, 3, 5}};
+    EXPECT_EQ(0b110u, details::containsMask(ranges, {2, 3}));
+    EXPECT_EQ(0b000u, details::containsMask(ranges, {2, 6}));
+    EXPECT_EQ(0b110u, details::supportedByMask(ranges, {2, 6}));
+    EXPECT_EQ(0b001u, details::supportedByMask(ranges, {1, 2}));
+    EXPECT_TRUE(details::anyContains(ranges, {1, 3}));
+    EXPECT_FALSE(details::anyContains(ranges, {1, 4}));
+    EXPECT_FALSE(details::anySupportedBy(ranges, {1, 1}));
+    EXPECT_FALSE(details::anySupportedBy(ranges, {3, 0}));
+}
+
+TEST_F(LibVintfTest, FqInstanceView) {
+    FqInstance fqInstance;
+    ASSERT_TRUE(fqInstance.setTo("android.hardware.foo@1.2::IFoo/default"));
+    auto view = details::FqInstanceView::from(fqInstance);
+    EXPECT_EQ("android.hardware.foo", view.package);
+    EXPECT_EQ(Version(1, 2), view.version);
+    EXPECT_EQ("IFoo", view.interface);
+    EXPECT_EQ("default", view.instance);
+
+    FqInstance converted;
+    ASSERT_TRUE(view.toFqInstance(&converted));
+    EXPECT_EQ(fqInstance, converted);
+
+    std::string other = "other";
+    auto otherView = view;
+    otherView.instance = other;
+    EXPECT_NE(view, otherView);
+    EXPECT_TRUE(view < otherView);
+
+    details::FqInstanceIndex index;
+    EXPECT_TRUE(index.empty());
+    index.insert(view);
+    index.insert(otherView);
+    EXPECT_TRUE(index.contains(1, 0, "IFoo", "default"));
+    EXPECT_TRUE(index.contains(1, 2, "IFoo", "other"));
+    EXPECT_FALSE(index.contains(1, 3, "IFoo", "default"));
+    EXPECT_FALSE(index.contains(2, 0, "IFoo", "default"));
+    EXPECT_FALSE(index.contains(1, 0, "IBar", "default"));
+    std::set<std::string_view> matched;
+    EXPECT_FALSE(index.anyInstanceOf(1, 1, "IFoo", [&](std::string_view instance) {
+        matched.insert(instance);
+        return false;
+    }));
+    EXPECT_EQ(std::set<std::string_view>({"default", "other"}), matched);
+    EXPECT_TRUE(index.anyInstanceOf(1, 1, "IFoo",
+                                    [](std::string_view instance) { return instance == "other"; }));
+    EXPECT_FALSE(index.anyInstanceOf(1, 3, "IFoo", [](std::string_view) { return true; }));
+}
+
 static bool insert(std::map<std::string, HalInterface>* map, HalInterface&& intf) {
     std::string name{intf.name()};
     return map->emplace(std::move(name), std::move(intf)).second;
 }
 
+TEST_F(LibVintfTest, HalInterfaceSharedInstances) {
+    HalInterface foo{"IFoo", {"default"}};
+    HalInterface bar{"IBar", {"default"}};
+    EXPECT_EQ(getInstances(foo), getInstances(bar));
+
+    // Copy on write.
+    EXPECT_TRUE(bar.insertInstance("legacy/0", false /* isRegex */));
+    EXPECT_NE(getInstances(foo), getInstances(bar));
+    EXPECT_EQ(std::set<std::string>({"default"}), *getInstances(foo));
+    EXPECT_EQ(std::set<std::string>({"default", "legacy/0"}), *getInstances(bar));
+
+    // Further mutations modify the private set in place.
+    const auto* barInstances = getInstances(bar).get();
+    for (size_t i = 1; i < 100; ++i) {
+        EXPECT_TRUE(bar.insertInstance("legacy/" + std::to_string(i), false /* isRegex */));
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        EXPECT_TRUE(bar.removeInstance("legacy/" + std::to_string(i), false /* isRegex */));
+    }
+    EXPECT_EQ(barInstances, getInstances(bar).get());
+    EXPECT_EQ(*getInstances(foo), *getInstances(bar));
+    EXPECT_FALSE(bar.removeInstance("legacy/0", false /* isRegex */));
+
+    // Copies share the private set until either of them is modified.
+    HalInterface barCopy = bar;
+    EXPECT_EQ(getInstances(bar), getInstances(barCopy));
+    EXPECT_TRUE(barCopy.insertInstance("legacy/0", false /* isRegex */));
+    EXPECT_EQ(std::set<std::string>({"default"}), *getInstances(bar));
+    EXPECT_EQ(std::set<std::string>({"default", "legacy/0"}), *getInstances(barCopy));
+
+    MatrixHal mh;
+    EXPECT_TRUE(gMatrixHalConverter(&mh,
+                                    "<hal format=\"hidl\" optional=\"false\">\n"
+                                    "    <name>android.hardware.baz</name>\n"
+                                    "    <version>1.0</version>\n"
+                                    "    <interface>\n"
+                                    "        <name>IBaz</name>\n"
+                                    "        <instance>default</instance>\n"
+                                    "    </interface>\n"
+                                    "</hal>\n"))
+        << gMatrixHalConverter.lastError();
+    EXPECT_EQ(getInstances(foo), getInstances(mh.interfaces["IBaz"]));
+}
+
+TEST_F(LibVintfTest, HalInterfaceSharedInstancesConcurrent) {
+    // Sets are created and released on several threads, some of them with the same content.
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([t] {
+            for (size_t i = 0; i < 1000; ++i) {
+                HalInterface intf{"IFoo", {"instance" + std::to_string((i + t) % 50)}};
+                HalInterface copy = intf;
+                EXPECT_TRUE(copy.insertInstance("extra", false /* isRegex */));
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    HalInterface foo{"IFoo", {"instance0"}};
+    HalInterface bar{"IBar", {"instance0"}};
+    EXPECT_EQ(getInstances(foo), getInstances(bar));
+}
+
 TEST_F(LibVintfTest, MatrixHalConverter) {
     MatrixHal mh{HalFormat::NATIVE, "android.hardware.camera",
             {{VersionRange(1,2,3), VersionRange(4,5,6)}},
@@ -2905,6 +3050,34 @@ TEST_F(LibVintfTest, ManifestAddOverrideHalRemoveAll) {
         gHalManifestConverter(manifest, SerializeFlags::HALS_ONLY));
 }
 
+// <fqname>s with the same major version, interface and instance are merged into the
+// one with the highest minor version.
+TEST_F(LibVintfTest, ManifestHalMergeFqnames) {
+    HalManifest manifest;
+    std::string xml =
+        "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.1::IFoo/default</fqname>\n"
+        "        <fqname>@1.3::IFoo/default</fqname>\n"
+        "        <fqname>@1.0::IFoo/default</fqname>\n"
+        "        <fqname>@2.0::IFoo/default</fqname>\n"
+        "    </hal>\n"
+        "</manifest>\n";
+    EXPECT_TRUE(gHalManifestConverter(&manifest, xml)) << gHalManifestConverter.lastError();
+    EXPECT_EQ(
+        "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.3::IFoo/default</fqname>\n"
+        "        <fqname>@2.0::IFoo/default</fqname>\n"
+        "    </hal>\n"
+        "</manifest>\n",
+        gHalManifestConverter(manifest, SerializeFlags::HALS_ONLY));
+}
+
 // Make sure missing tags in old VINTF files does not cause incompatibilities.
 TEST_F(LibVintfTest, Empty) {
     CompatibilityMatrix cm;
@@ -3106,6 +3279,290 @@ TEST_F(LibVintfTest, MatrixDetailErrorMsg) {
     }
 }
 
+TEST_F(LibVintfTest, CompatibilityReport) {
+    std::string error;
+    std::string xml;
+
+    HalManifest manifest;
+    xml =
+        "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.0::IFoo/default</fqname>\n"
+        "    </hal>\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.baz</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.0::IBaz/default</fqname>\n"
+        "    </hal>\n"
+        "    <sepolicy>\n"
+        "        <version>25.5</version>\n"
+        "    </sepolicy>\n"
+        "</manifest>\n";
+    ASSERT_TRUE(gHalManifestConverter(&manifest, xml, &error)) << error;
+
+    CompatibilityMatrix cm;
+    xml =
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>1.2</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.bar</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IBar</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.baz</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IBaz</name>\n"
+        "            <instance>other</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <sepolicy>\n"
+        "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+        "        <sepolicy-version>25.5</sepolicy-version>\n"
+        "    </sepolicy>\n"
+        "</compatibility-matrix>\n";
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&cm, xml, &error)) << error;
+
+    CompatibilityReport report;
+    EXPECT_FALSE(manifest.getCompatibilityReport(cm, &report));
+    ASSERT_EQ(3u, report.issues().size());
+    std::map<std::string, const CompatibilityIssue*> issues;
+    for (const auto& issue : report.issues()) {
+        EXPECT_TRUE(issue.isHal());
+        issues[issue.matrixHal->name] = &issue;
+    }
+    ASSERT_NE(nullptr, issues["android.hardware.bar"]);
+    EXPECT_EQ(CompatibilityIssue::Type::HAL_MISSING, issues["android.hardware.bar"]->type);
+    EXPECT_TRUE(issues["android.hardware.bar"]->manifestHals.empty());
+    ASSERT_NE(nullptr, issues["android.hardware.foo"]);
+    EXPECT_EQ(CompatibilityIssue::Type::HAL_VERSION, issues["android.hardware.foo"]->type);
+    ASSERT_EQ(1u, issues["android.hardware.foo"]->manifestHals.size());
+    EXPECT_EQ("android.hardware.foo", issues["android.hardware.foo"]->manifestHals[0]->name);
+    ASSERT_NE(nullptr, issues["android.hardware.baz"]);
+    EXPECT_EQ(CompatibilityIssue::Type::HAL_INSTANCE, issues["android.hardware.baz"]->type);
+
+    EXPECT_FALSE(manifest.checkCompatibility(cm, &error));
+    EXPECT_EQ(error, report.toString());
+    EXPECT_FALSE(manifest.checkCompatibility(cm, nullptr, CheckFlags::DEFAULT));
+    EXPECT_IN(
+        "android.hardware.foo:\n"
+        "    required: @1.2::IFoo/default\n"
+        "    provided: @1.0::IFoo/default",
+        error);
+
+    // Only the first incompatible part is reported.
+    CompatibilityMatrix sepolicyMatrix;
+    xml =
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\">\n"
+        "    <sepolicy>\n"
+        "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+        "        <sepolicy-version>26.0</sepolicy-version>\n"
+        "    </sepolicy>\n"
+        "</compatibility-matrix>\n";
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&sepolicyMatrix, xml, &error)) << error;
+    CompatibilityReport sepolicyReport;
+    EXPECT_FALSE(manifest.getCompatibilityReport(sepolicyMatrix, &sepolicyReport));
+    ASSERT_EQ(1u, sepolicyReport.issues().size());
+    EXPECT_EQ(CompatibilityIssue::Type::SEPOLICY, sepolicyReport.issues()[0].type);
+    EXPECT_EQ("Sepolicy version 25.5 doesn't satisify the requirements.",
+              sepolicyReport.toString());
+}
+
+TEST_F(LibVintfTest, CompatibilityReportKernel) {
+    RuntimeInfo runtime = testRuntimeInfo();
+    auto testMatrix = [&](MatrixKernel&& kernel) {
+        CompatibilityMatrix cm;
+        add(cm, std::move(kernel));
+        set(cm, {30, {{25, 0}}});
+        setAvb(cm, {2, 1});
+        return cm;
+    };
+    std::string error;
+
+    {
+        CompatibilityMatrix cm = testMatrix(MatrixKernel(KernelVersion{4, 4, 1}, {}));
+        CompatibilityReport report;
+        EXPECT_FALSE(runtime.getCompatibilityReport(cm, &report));
+        ASSERT_EQ(1u, report.issues().size());
+        const auto& issue = report.issues()[0];
+        EXPECT_EQ(CompatibilityIssue::Type::KERNEL_VERSION, issue.type);
+        ASSERT_NE(nullptr, issue.kernel);
+        EXPECT_EQ(runtime.kernelVersion(), issue.kernel->version());
+        EXPECT_EQ(nullptr, issue.kernelConfig);
+        EXPECT_FALSE(runtime.checkCompatibility(cm, &error));
+        EXPECT_EQ(error, report.toString());
+    }
+
+    {
+        CompatibilityMatrix cm = testMatrix(MatrixKernel(
+            KernelVersion{3, 18, 22}, {KernelConfig{"CONFIG_64BIT", Tristate::YES},
+                                       KernelConfig{"CONFIG_ARCH_MMAP_RND_BITS", 30}}));
+        CompatibilityReport report;
+        EXPECT_FALSE(runtime.getCompatibilityReport(cm, &report));
+        ASSERT_EQ(1u, report.issues().size());
+        const auto& issue = report.issues()[0];
+        EXPECT_EQ(CompatibilityIssue::Type::KERNEL_CONFIG, issue.type);
+        ASSERT_NE(nullptr, issue.kernelConfig);
+        EXPECT_EQ("CONFIG_ARCH_MMAP_RND_BITS", issue.kernelConfig->first);
+        EXPECT_EQ(KernelConfigTypedValue(30), issue.kernelConfig->second);
+        ASSERT_NE(nullptr, issue.kernelConfigValue);
+        EXPECT_EQ("24", *issue.kernelConfigValue);
+        EXPECT_FALSE(runtime.checkCompatibility(cm, &error));
+        EXPECT_EQ(error, report.toString());
+        EXPECT_IN("For config CONFIG_ARCH_MMAP_RND_BITS, value = 24 but required 30", error);
+    }
+
+    {
+        CompatibilityMatrix cm = testMatrix(
+            MatrixKernel(KernelVersion{3, 18, 22}, {KernelConfig{"CONFIG_NOTEXIST", "foo"}}));
+        CompatibilityReport report;
+        EXPECT_FALSE(runtime.getCompatibilityReport(cm, &report));
+        ASSERT_EQ(1u, report.issues().size());
+        const auto& issue = report.issues()[0];
+        EXPECT_EQ(CompatibilityIssue::Type::KERNEL_CONFIG, issue.type);
+        ASSERT_NE(nullptr, issue.kernelConfig);
+        EXPECT_EQ("CONFIG_NOTEXIST", issue.kernelConfig->first);
+        EXPECT_EQ(nullptr, issue.kernelConfigValue);
+        EXPECT_IN("Missing config CONFIG_NOTEXIST", report.toString());
+    }
+}
+
+TEST_F(LibVintfTest, HidlInheritanceGraph) {
+    HidlInheritanceGraph graph({
+        {"android.hardware.foo@1.1::IFoo", {"android.hardware.foo@1.0::IFoo"}},
+        {"android.hardware.foo@1.2::IFoo",
+         {"android.hardware.foo@1.1::IFoo", "android.hardware.foo@1.0::IFoo"}},
+        {"android.hardware.bar@1.0::IBar", {"not a name"}},
+        // Only the direct parent is listed.
+        {"android.hardware.baz@1.1::IBaz", {"android.hardware.baz@1.0::IBaz"}},
+        {"android.hardware.baz@1.2::IBaz", {"android.hardware.baz@1.1::IBaz"}},
+    });
+
+    auto foo10 = graph.find("android.hardware.foo@1.0::IFoo");
+    auto foo11 = graph.find("android.hardware.foo@1.1::IFoo");
+    auto foo12 = graph.find("android.hardware.foo@1.2::IFoo");
+    ASSERT_TRUE(foo10.has_value());
+    ASSERT_TRUE(foo11.has_value());
+    ASSERT_TRUE(foo12.has_value());
+    EXPECT_FALSE(graph.find("android.hardware.foo@2.0::IFoo").has_value());
+
+    EXPECT_EQ((std::vector<HidlInheritanceGraph::NodeId>{*foo11, *foo12}),
+              graph.children(*foo10));
+    EXPECT_EQ((std::vector<HidlInheritanceGraph::NodeId>{*foo12}), graph.children(*foo11));
+    EXPECT_TRUE(graph.children(*foo12).empty());
+    EXPECT_EQ((std::vector<HidlInheritanceGraph::NodeId>{*foo11, *foo12}),
+              graph.descendants(*foo10));
+    EXPECT_TRUE(graph.descendants(*foo12).empty());
+    auto baz10 = graph.find("android.hardware.baz@1.0::IBaz");
+    auto baz11 = graph.find("android.hardware.baz@1.1::IBaz");
+    auto baz12 = graph.find("android.hardware.baz@1.2::IBaz");
+    ASSERT_TRUE(baz10.has_value() && baz11.has_value() && baz12.has_value());
+    EXPECT_EQ((std::vector<HidlInheritanceGraph::NodeId>{*baz11}), graph.children(*baz10));
+    EXPECT_EQ((std::vector<HidlInheritanceGraph::NodeId>{*baz11, *baz12}),
+              graph.descendants(*baz10));
+
+    ASSERT_NE(nullptr, graph.fqName(*foo11));
+    EXPECT_EQ("android.hardware.foo", graph.fqName(*foo11)->package());
+    EXPECT_EQ("IFoo", graph.fqName(*foo11)->name());
+    auto invalid = graph.find("not a name");
+    ASSERT_TRUE(invalid.has_value());
+    EXPECT_EQ(nullptr, graph.fqName(*invalid));
+    EXPECT_EQ("not a name", graph.name(*invalid));
+}
+
+TEST_F(LibVintfTest, CheckPlan) {
+    std::string error;
+    std::string xml;
+
+    CompatibilityMatrix cm;
+    xml =
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "            <regex-instance>legacy/[0-9]+</regex-instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>2.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>custom</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <hal format=\"hidl\" optional=\"true\">\n"
+        "        <name>android.hardware.bar</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IBar</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <sepolicy>\n"
+        "        <kernel-sepolicy-version>30</kernel-sepolicy-version>\n"
+        "        <sepolicy-version>25.5</sepolicy-version>\n"
+        "    </sepolicy>\n"
+        "</compatibility-matrix>\n";
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&cm, xml, &error)) << error;
+    CheckPlan plan(cm);
+
+    auto manifestXml = [](const std::string& fqnames) {
+        return "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+               "    <hal format=\"hidl\">\n"
+               "        <name>android.hardware.foo</name>\n"
+               "        <transport>hwbinder</transport>\n" +
+               fqnames +
+               "    </hal>\n"
+               "    <sepolicy>\n"
+               "        <version>25.5</version>\n"
+               "    </sepolicy>\n"
+               "</manifest>\n";
+    };
+    for (const auto& [fqnames, compatible] : std::vector<std::pair<std::string, bool>>{
+             {"        <fqname>@1.0::IFoo/default</fqname>\n"
+              "        <fqname>@1.0::IFoo/legacy/0</fqname>\n"
+              "        <fqname>@2.0::IFoo/custom</fqname>\n",
+              true},
+             {"        <fqname>@1.0::IFoo/default</fqname>\n"
+              "        <fqname>@2.0::IFoo/custom</fqname>\n",
+              false},
+             {"        <fqname>@1.0::IFoo/default</fqname>\n"
+              "        <fqname>@1.0::IFoo/legacy/x</fqname>\n"
+              "        <fqname>@2.0::IFoo/custom</fqname>\n",
+              false},
+             {"        <fqname>@1.0::IFoo/default</fqname>\n"
+              "        <fqname>@1.0::IFoo/legacy/0</fqname>\n",
+              false},
+         }) {
+        HalManifest manifest;
+        ASSERT_TRUE(gHalManifestConverter(&manifest, manifestXml(fqnames), &error)) << error;
+
+        std::string matrixError;
+        std::string planError;
+        EXPECT_EQ(compatible, manifest.checkCompatibility(cm, &matrixError)) << fqnames;
+        EXPECT_EQ(compatible, manifest.checkCompatibility(plan, &planError)) << fqnames;
+        EXPECT_EQ(compatible, manifest.checkCompatibility(plan)) << fqnames;
+        EXPECT_EQ(matrixError, planError);
+    }
+}
+
 TEST_F(LibVintfTest, DisabledHal) {
     std::string error;
     std::string xml;
@@ -3479,6 +3936,140 @@ TEST_F(LibVintfTest, KernelInfo) {
         gKernelInfoConverter(ki, SerializeFlags::NO_TAGS.enableKernelConfigs()));
 }
 
+TEST_F(LibVintfTest, KernelInfoMatchTypedConfigs) {
+    KernelInfo ki = testKernelInfo();
+    addKernelConfig(ki, "CONFIG_RANGE", "3-5");
+    addKernelConfig(ki, "CONFIG_UNKNOWN", "foo");
+    addKernelConfig(ki, "CONFIG_EXPLICIT_NO", "n");
+
+    std::vector<std::pair<KernelConfig, bool>> requirements{
+        {KernelConfig("CONFIG_64BIT", Tristate::YES), true},
+        {KernelConfig("CONFIG_64BIT", Tristate::MODULE), false},
+        {KernelConfig("CONFIG_64BIT", std::string("y")), false},
+        {KernelConfig("CONFIG_ANDROID_BINDER_DEVICES", std::string("binder,hwbinder")), true},
+        {KernelConfig("CONFIG_ANDROID_BINDER_DEVICES", std::string("binder")), false},
+        {KernelConfig("CONFIG_BUILD_ARM64_APPENDED_DTB_IMAGE_NAMES", std::string("")), true},
+        {KernelConfig("CONFIG_ARCH_MMAP_RND_BITS", KernelConfigIntValue{24}), true},
+        {KernelConfig("CONFIG_ARCH_MMAP_RND_BITS", KernelConfigIntValue{0x18}), true},
+        {KernelConfig("CONFIG_ARCH_MMAP_RND_BITS", KernelConfigRangeValue{24, 24}), false},
+        {KernelConfig("CONFIG_ILLEGAL_POINTER_VALUE",
+                      KernelConfigIntValue{static_cast<KernelConfigIntValue>(0xdead000000000000)}),
+         true},
+        {KernelConfig("CONFIG_RANGE", KernelConfigRangeValue{3, 5}), true},
+        {KernelConfig("CONFIG_RANGE", KernelConfigRangeValue{3, 6}), false},
+        {KernelConfig("CONFIG_UNKNOWN", std::string("foo")), false},
+        {KernelConfig("CONFIG_MISSING", Tristate::NO), true},
+        {KernelConfig("CONFIG_MISSING", Tristate::YES), false},
+        {KernelConfig("CONFIG_MISSING", Tristate::MODULE), false},
+        {KernelConfig("CONFIG_EXPLICIT_NO", Tristate::NO), true},
+        {KernelConfig("CONFIG_EXPLICIT_NO", Tristate::YES), false},
+        {KernelConfig("CONFIG_EXPLICIT_NO", Tristate::MODULE), false},
+    };
+
+    for (const auto& [config, expected] : requirements) {
+        std::string error;
+        EXPECT_EQ(expected, ki.matchKernelConfigs({config}, &error))
+            << config.first << ": " << error;
+
+        // Same result when configs are parsed once and shared across requirements, and when
+        // tristate configs are matched as bitsets.
+        std::vector<MatrixKernel> kernels;
+        kernels.emplace_back(KernelVersion{3, 18, 31}, std::vector<KernelConfig>{config});
+        EXPECT_EQ(expected, matchKernels(ki, kernels, &error)) << config.first << ": " << error;
+    }
+
+    std::string error;
+    EXPECT_FALSE(matchKernels(
+        ki,
+        {MatrixKernel(KernelVersion{3, 18, 31}, {KernelConfig("CONFIG_MISSING", Tristate::YES)})},
+        &error));
+    EXPECT_IN("Missing config CONFIG_MISSING", error);
+    EXPECT_FALSE(matchKernels(
+        ki,
+        {MatrixKernel(KernelVersion{3, 18, 31},
+                      {KernelConfig("CONFIG_EXPLICIT_NO", Tristate::YES)})},
+        &error));
+    EXPECT_IN("For config CONFIG_EXPLICIT_NO, value = n but required y", error);
+}
+
+TEST_F(LibVintfTest, KernelInfoMatchManyTristateConfigs) {
+    // More than 64 keys, so tristate bits span multiple words.
+    constexpr size_t kNumConfigs = 100;
+    KernelInfo ki = testKernelInfo();
+    std::vector<KernelConfig> configs;
+    for (size_t i = 0; i < kNumConfigs; ++i) {
+        std::string key = "CONFIG_TRISTATE_" + std::to_string(i);
+        addKernelConfig(ki, key, i % 2 == 0 ? "y" : "m");
+        configs.emplace_back(key, i % 2 == 0 ? Tristate::YES : Tristate::MODULE);
+    }
+    std::string error;
+    EXPECT_TRUE(matchKernels(ki, {MatrixKernel(KernelVersion{3, 18, 31}, std::vector(configs))},
+                             &error))
+        << error;
+
+    // Only the last key, in the second word, does not match.
+    auto unmet = configs;
+    unmet.back().second = Tristate::YES;
+    EXPECT_FALSE(matchKernels(ki, {MatrixKernel(KernelVersion{3, 18, 31}, std::move(unmet))},
+                              &error));
+    EXPECT_IN("For config CONFIG_TRISTATE_99, value = m but required y", error);
+
+    // A key past the first word that the kernel does not set.
+    auto missing = configs;
+    missing.emplace_back("CONFIG_TRISTATE_MISSING", Tristate::YES);
+    EXPECT_FALSE(matchKernels(ki, {MatrixKernel(KernelVersion{3, 18, 31}, std::move(missing))},
+                              &error));
+    EXPECT_IN("Missing config CONFIG_TRISTATE_MISSING", error);
+}
+
+TEST_F(LibVintfTest, KernelInfoMatchConditions) {
+    KernelInfo ki = testKernelInfo();
+    auto parseKernels = [&](const std::string& conditionValue, const std::string& configValue) {
+        std::string xml =
+            "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\">\n"
+            "    <kernel version=\"3.18.22\"/>\n"
+            "    <kernel version=\"3.18.22\">\n"
+            "        <conditions>\n"
+            "            <config>\n"
+            "                <key>CONFIG_64BIT</key>\n"
+            "                <value type=\"tristate\">" + conditionValue + "</value>\n"
+            "            </config>\n"
+            "        </conditions>\n"
+            "        <config>\n"
+            "            <key>CONFIG_ARCH_MMAP_RND_BITS</key>\n"
+            "            <value type=\"int\">" + configValue + "</value>\n"
+            "        </config>\n"
+            "    </kernel>\n"
+            "</compatibility-matrix>\n";
+        CompatibilityMatrix cm;
+        EXPECT_TRUE(gCompatibilityMatrixConverter(&cm, xml))
+            << gCompatibilityMatrixConverter.lastError();
+        return getKernels(cm);
+    };
+    std::string error;
+
+    // Conditions met; configs are checked.
+    EXPECT_TRUE(matchKernels(ki, parseKernels("y", "24"), &error)) << error;
+    EXPECT_FALSE(matchKernels(ki, parseKernels("y", "26"), &error));
+    EXPECT_IN("For config CONFIG_ARCH_MMAP_RND_BITS, value = 24 but required 26", error);
+
+    // Conditions not met; the fragment is ignored.
+    EXPECT_TRUE(matchKernels(ki, parseKernels("n", "26"), &error)) << error;
+
+    // Without the unconditional fragment, unmet conditions are reported.
+    auto kernels = parseKernels("n", "26");
+    kernels.erase(kernels.begin());
+    EXPECT_FALSE(matchKernels(ki, kernels, &error));
+    EXPECT_IN("Framework matches kernel version with unmet conditions.", error);
+    EXPECT_IN("For config CONFIG_64BIT, value = y but required n", error);
+    const KernelConfig* unmetConfig = nullptr;
+    EXPECT_TRUE(
+        ki.getMatchedKernelRequirements(kernels, Level::UNSPECIFIED, nullptr, &unmetConfig)
+            .empty());
+    ASSERT_NE(nullptr, unmetConfig);
+    EXPECT_EQ("CONFIG_64BIT", unmetConfig->first);
+}
+
 TEST_F(LibVintfTest, ManifestAddAllDeviceManifest) {
     std::string xml1 = "<manifest " + kMetaVersionStr + " type=\"device\" />\n";
     std::string xml2 =
@@ -4028,6 +4619,228 @@ TEST_F(FrameworkCompatibilityMatrixCombineTest, KernelNoConditions) {
               gCompatibilityMatrixConverter(*combined));
 }
 
+TEST_F(FrameworkCompatibilityMatrixCombineTest, AllLevels) {
+    ASSERT_TRUE(gCompatibilityMatrixConverter(
+        &matrices[0].object,
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\" level=\"1\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <kernel version=\"3.18.5\" />\n"
+        "</compatibility-matrix>\n",
+        &error))
+        << error;
+    ASSERT_TRUE(gCompatibilityMatrixConverter(
+        &matrices[1].object,
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\" level=\"2\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>2.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <kernel version=\"4.4.1\" />\n"
+        "</compatibility-matrix>\n",
+        &error))
+        << error;
+    matrices.push_back({"compatibility_matrix.3.xml", CompatibilityMatrix{}});
+    ASSERT_TRUE(gCompatibilityMatrixConverter(
+        &matrices[2].object,
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\" level=\"3\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <version>3.0</version>\n"
+        "        <interface>\n"
+        "            <name>IFoo</name>\n"
+        "            <instance>default</instance>\n"
+        "            <instance>other</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "    <kernel version=\"4.9.1\" />\n"
+        "</compatibility-matrix>\n",
+        &error))
+        << error;
+    matrices.push_back({"compatibility_matrix.empty.xml", CompatibilityMatrix{}});
+    ASSERT_TRUE(gCompatibilityMatrixConverter(
+        &matrices[3].object,
+        "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\">\n"
+        "    <hal format=\"hidl\" optional=\"false\">\n"
+        "        <name>android.hardware.bar</name>\n"
+        "        <version>1.0</version>\n"
+        "        <interface>\n"
+        "            <name>IBar</name>\n"
+        "            <instance>default</instance>\n"
+        "        </interface>\n"
+        "    </hal>\n"
+        "</compatibility-matrix>\n",
+        &error))
+        << error;
+    auto copy = matrices;
+
+    std::map<Level, std::string> errors;
+    auto all = CompatibilityMatrix::combineAllLevels(matrices, &errors);
+    ASSERT_EQ(3u, all.size());
+    EXPECT_TRUE(errors.empty());
+    ASSERT_EQ(copy.size(), matrices.size());
+    for (size_t i = 0; i < copy.size(); ++i) {
+        EXPECT_EQ(copy[i].object, matrices[i].object) << "input should not be modified";
+    }
+
+    for (Level level : {Level{1}, Level{2}, Level{3}}) {
+        auto copyForLevel = copy;
+        auto expected = combine(level, &copyForLevel, &error);
+        ASSERT_NE(nullptr, expected) << error;
+        ASSERT_NE(nullptr, all[level]);
+        EXPECT_EQ(gCompatibilityMatrixConverter(*expected),
+                  gCompatibilityMatrixConverter(*all[level]));
+    }
+
+    // Without a matrix of unspecified level, the result of a level is reused for the levels
+    // below it.
+    copy.pop_back();
+    all = CompatibilityMatrix::combineAllLevels(copy, &errors);
+    EXPECT_TRUE(errors.empty());
+    for (Level level : {Level{1}, Level{2}, Level{3}}) {
+        auto copyForLevel = copy;
+        auto expected = combine(level, &copyForLevel, &error);
+        ASSERT_NE(nullptr, expected) << error;
+        ASSERT_NE(nullptr, all[level]);
+        EXPECT_EQ(gCompatibilityMatrixConverter(*expected),
+                  gCompatibilityMatrixConverter(*all[level]));
+    }
+}
+
+// Test that a level that cannot be combined does not prevent other levels from being combined.
+TEST_F(FrameworkCompatibilityMatrixCombineTest, AllLevelsConflict) {
+    auto matrixXml = [](const std::string& level, const std::string& kernel,
+                        const std::string& sepolicy) {
+        return "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\" level=\"" +
+               level + "\">\n"
+               "    <kernel version=\"" + kernel + "\" />\n"
+               "    <sepolicy>\n"
+               "        <kernel-sepolicy-version>" + sepolicy + "</kernel-sepolicy-version>\n"
+               "    </sepolicy>\n"
+               "</compatibility-matrix>\n";
+    };
+    matrices.push_back({"compatibility_matrix.2_1.xml", CompatibilityMatrix{}});
+    matrices.push_back({"compatibility_matrix.2_2.xml", CompatibilityMatrix{}});
+    matrices.push_back({"compatibility_matrix.3.xml", CompatibilityMatrix{}});
+    // Level 1 has conflicting kernel versions.
+    for (const auto& [i, xml] : std::vector<std::pair<size_t, std::string>>{
+             {0, matrixXml("1", "3.18.5", "30")},
+             {1, matrixXml("1", "3.18.6", "30")},
+             // Level 2 has conflicting <sepolicy>, which is ignored for level 1.
+             {2, matrixXml("2", "4.4.1", "30")},
+             {3, matrixXml("2", "4.4.1", "29")},
+             {4, matrixXml("3", "4.9.1", "30")}}) {
+        ASSERT_TRUE(gCompatibilityMatrixConverter(&matrices[i].object, xml, &error)) << error;
+    }
+
+    std::map<Level, std::string> errors;
+    auto all = CompatibilityMatrix::combineAllLevels(matrices, &errors);
+    ASSERT_EQ(3u, all.size());
+    EXPECT_EQ(nullptr, all[Level{1}]);
+    EXPECT_IN("Kernel version mismatch", errors[Level{1}]);
+    EXPECT_EQ(nullptr, all[Level{2}]);
+    EXPECT_IN("<sepolicy> is already defined", errors[Level{2}]);
+    ASSERT_NE(nullptr, all[Level{3}]);
+    EXPECT_EQ(0u, errors.count(Level{3}));
+
+    // Without its own conflict, level 1 is combined even though level 2 cannot be.
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&matrices[1].object,
+                                              matrixXml("1", "3.18.5", "30"), &error))
+        << error;
+    errors.clear();
+    all = CompatibilityMatrix::combineAllLevels(matrices, &errors);
+    ASSERT_NE(nullptr, all[Level{1}]) << errors[Level{1}];
+    auto copy = matrices;
+    auto expected = combine(Level{1}, &copy, &error);
+    ASSERT_NE(nullptr, expected) << error;
+    EXPECT_EQ(gCompatibilityMatrixConverter(*expected),
+              gCompatibilityMatrixConverter(*all[Level{1}]));
+}
+
+TEST_F(FrameworkCompatibilityMatrixCombineTest, CheckCompatibilityForAllLevels) {
+    auto matrixXml = [](const std::string& level, const std::string& version,
+                        const std::string& kernelSepolicyVersion = "30") {
+        return "<compatibility-matrix " + kMetaVersionStr + " type=\"framework\" level=\"" +
+               level + "\">\n"
+               "    <hal format=\"hidl\" optional=\"false\">\n"
+               "        <name>android.hardware.foo</name>\n"
+               "        <version>" + version + "</version>\n"
+               "        <interface>\n"
+               "            <name>IFoo</name>\n"
+               "            <instance>default</instance>\n"
+               "        </interface>\n"
+               "    </hal>\n"
+               "    <sepolicy>\n"
+               "        <kernel-sepolicy-version>" + kernelSepolicyVersion +
+               "</kernel-sepolicy-version>\n"
+               "        <sepolicy-version>25.0</sepolicy-version>\n"
+               "    </sepolicy>\n"
+               "</compatibility-matrix>\n";
+    };
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&matrices[0].object, matrixXml("1", "1.0"), &error))
+        << error;
+    ASSERT_TRUE(gCompatibilityMatrixConverter(&matrices[1].object, matrixXml("2", "2.0"), &error))
+        << error;
+    // Level 3 requires the same HALs as level 2. Level 4 cannot be combined.
+    for (const auto& [name, xml] : std::vector<std::pair<std::string, std::string>>{
+             {"compatibility_matrix.3.xml", matrixXml("3", "2.0")},
+             {"compatibility_matrix.4_1.xml", matrixXml("4", "2.0", "30")},
+             {"compatibility_matrix.4_2.xml", matrixXml("4", "2.0", "31")}}) {
+        matrices.push_back({name, CompatibilityMatrix{}});
+        ASSERT_TRUE(gCompatibilityMatrixConverter(&matrices.back().object, xml, &error)) << error;
+    }
+
+    HalManifest manifest;
+    ASSERT_TRUE(gHalManifestConverter(
+        &manifest,
+        "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.foo</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.0::IFoo/default</fqname>\n"
+        "    </hal>\n"
+        "    <sepolicy>\n"
+        "        <version>25.0</version>\n"
+        "    </sepolicy>\n"
+        "</manifest>\n",
+        &error))
+        << error;
+
+    auto results = manifest.checkCompatibilityForAllLevels(matrices, &error);
+    ASSERT_EQ(4u, results.size()) << error;
+    EXPECT_EQ(Level{1}, results[0].level);
+    EXPECT_TRUE(results[0].compatible) << results[0].error;
+    EXPECT_EQ(Level{2}, results[1].level);
+    EXPECT_FALSE(results[1].compatible);
+    EXPECT_IN("android.hardware.foo", results[1].error);
+    EXPECT_EQ(Level{3}, results[2].level);
+    EXPECT_FALSE(results[2].compatible);
+    EXPECT_EQ(results[1].error, results[2].error);
+    EXPECT_EQ(Level{4}, results[3].level);
+    EXPECT_FALSE(results[3].compatible);
+    EXPECT_IN("<sepolicy> is already defined", results[3].error);
+
+    // Each result is the same as checking against the matrix combined for that level.
+    for (const auto& result : results) {
+        auto copy = matrices;
+        auto combined = combine(result.level, &copy, &error);
+        if (combined == nullptr) continue;
+        std::string checkError;
+        EXPECT_EQ(result.compatible, manifest.checkCompatibility(*combined, &checkError));
+        EXPECT_IN(result.error, checkError);
+    }
+}
+
 // Combining framework compatibility matrix with conflicting sepolicy fails
 TEST_F(FrameworkCompatibilityMatrixCombineTest, ConflictSepolicy) {
     ASSERT_TRUE(gCompatibilityMatrixConverter(
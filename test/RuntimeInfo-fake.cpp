@@ -16,6 +16,8 @@
 
 #include "utils-fake.h"
 
+#include "parse_string.h"
+
 namespace android {
 namespace vintf {
 namespace details {
@@ -28,6 +30,8 @@ MockRuntimeInfo::MockRuntimeInfo() {
                              {"CONFIG_BUILD_ARM64_APPENDED_DTB_IMAGE_NAMES", "\"\""},
                              {"CONFIG_ILLEGAL_POINTER_VALUE", "0xdead000000000000"}};
     ON_CALL(*this, fetchAllInformation(_)).WillByDefault(Invoke(this, &MockRuntimeInfo::doFetch));
+    ON_CALL(*this, fetchIdentity(_, _))
+        .WillByDefault(Invoke(this, &MockRuntimeInfo::doFetchIdentity));
 }
 
 status_t MockRuntimeInfo::doFetch(RuntimeInfo::FetchFlags flags) {
@@ -55,6 +59,20 @@ status_t MockRuntimeInfo::doFetch(RuntimeInfo::FetchFlags flags) {
     // fetchAllInformtion does not fetch kernel FCM version
     return OK;
 }
+// Only the kernel info may differ between fetches.
+status_t MockRuntimeInfo::doFetchIdentity(RuntimeInfo::FetchFlags flags,
+                                          std::string* identity) const {
+    identity->clear();
+    if (flags & RuntimeInfo::FetchFlag::CPU_VERSION) {
+        *identity += to_string(kernel_info_.mVersion) + "\n";
+    }
+    if (flags & RuntimeInfo::FetchFlag::CONFIG_GZ) {
+        for (const auto& [key, value] : kernel_info_.mConfigs) {
+            *identity += key + "=" + value + "\n";
+        }
+    }
+    return OK;
+}
 void MockRuntimeInfo::setNextFetchKernelInfo(KernelVersion&& v,
                                              std::map<std::string, std::string>&& configs) {
     kernel_info_.mVersion = std::move(v);
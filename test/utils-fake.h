@@ -49,7 +49,9 @@ class MockRuntimeInfo : public RuntimeInfo {
    public:
     MockRuntimeInfo();
     MOCK_METHOD1(fetchAllInformation, status_t(RuntimeInfo::FetchFlags));
+    MOCK_CONST_METHOD2(fetchIdentity, status_t(RuntimeInfo::FetchFlags, std::string*));
     status_t doFetch(RuntimeInfo::FetchFlags flags);
+    status_t doFetchIdentity(RuntimeInfo::FetchFlags flags, std::string* identity) const;
     void failNextFetch() { failNextFetch_ = true; }
     void setNextFetchKernelInfo(KernelVersion&& v, std::map<std::string, std::string>&& configs);
     void setNextFetchKernelInfo(const KernelVersion& v,
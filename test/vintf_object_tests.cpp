@@ -19,6 +19,8 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include <thread>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -473,6 +475,11 @@ class VintfObjectTestBase : public ::testing::Test {
         return static_cast<MockRuntimeInfoFactory&>(*vintfObject->getRuntimeInfoFactory());
     }
 
+    // Fetch the device manifest without caching it, so that the error is returned.
+    status_t fetchDeviceHalManifest(HalManifest* out, std::string* error) {
+        return vintfObject->fetchDeviceHalManifest(out, error);
+    }
+
     std::unique_ptr<VintfObject> vintfObject;
 };
 
@@ -524,6 +531,446 @@ TEST_F(VintfObjectIncompatibleTest, TestDeviceCompatibility) {
     ASSERT_EQ(result, 1) << "Should have failed:" << error.c_str();
 }
 
+// Same result without an error message.
+TEST_F(VintfObjectIncompatibleTest, TestDeviceCompatibilityNoError) {
+    expectVendorManifest();
+    expectSystemManifest();
+    expectVendorMatrix();
+    expectSystemMatrix();
+
+    EXPECT_EQ(INCOMPATIBLE, vintfObject->checkCompatibility(nullptr));
+}
+
+// A MockFileSystem that supports getStat if any stats are set.
+class StatMockFileSystem : public MockFileSystem {
+   public:
+    StatMockFileSystem(const std::map<std::string, FileStat>* stats) : mStats(stats) {}
+    status_t getStat(const std::string& path, FileStat* out, std::string*) const override {
+        if (mStats->empty()) return INVALID_OPERATION;
+        auto it = mStats->find(path);
+        if (it == mStats->end()) return NAME_NOT_FOUND;
+        *out = it->second;
+        return OK;
+    }
+
+   private:
+    const std::map<std::string, FileStat>* mStats;
+};
+
+// Test that checkCompatibility results are cached on disk across VintfObjects.
+class VintfObjectCompatibilityCacheTest : public ::testing::Test {
+   protected:
+    // Build a VintfObject that reads the given system matrix. Return the mock file system
+    // in fileSystem.
+    std::unique_ptr<VintfObject> build(const std::string& systemMatrixXml,
+                                       MockFileSystem** fileSystem, bool useCache = true,
+                                       bool concurrent = false) {
+        auto mockFileSystem = std::make_unique<NiceMock<StatMockFileSystem>>(&fileStats);
+        ON_CALL(*mockFileSystem, listFiles(_, _, _)).WillByDefault(Return(NAME_NOT_FOUND));
+        ON_CALL(*mockFileSystem, fetch(_, _)).WillByDefault(Return(NAME_NOT_FOUND));
+        std::map<std::string, std::string> files{
+            {kVendorLegacyManifest, vendorManifestXml1},
+            {kSystemManifest, systemManifestXml1},
+            {kVendorLegacyMatrix, vendorMatrixXml1},
+            {kSystemLegacyMatrix, systemMatrixXml},
+        };
+        for (const auto& [path, content] : files) {
+            ON_CALL(*mockFileSystem, fetch(StrEq(path), _))
+                .WillByDefault(Invoke([content = content](const auto&, auto& out) {
+                    out = content;
+                    return ::android::OK;
+                }));
+        }
+        *fileSystem = mockFileSystem.get();
+        runtimeInfo = std::make_shared<NiceMock<MockRuntimeInfo>>();
+        VintfObject::Builder builder;
+        builder.setFileSystem(std::move(mockFileSystem))
+            .setRuntimeInfoFactory(std::make_unique<NiceMock<MockRuntimeInfoFactory>>(runtimeInfo))
+            .setPropertyFetcher(std::make_unique<NiceMock<MockPropertyFetcher>>())
+            .setConcurrentChecks(concurrent);
+        if (useCache) builder.setCompatibilityCache(cacheFile.path);
+        if (useObjectCache) builder.setObjectCache(objectCacheFile.path);
+        return builder.build();
+    }
+
+    // XML of all objects returned by the getters of vintfObject.
+    static std::vector<std::string> getObjectsXml(VintfObject* vintfObject) {
+        std::vector<std::string> ret;
+        for (const auto& manifest :
+             {vintfObject->getDeviceHalManifest(), vintfObject->getFrameworkHalManifest()}) {
+            ret.push_back(manifest == nullptr ? "" : gHalManifestConverter(*manifest));
+        }
+        for (const auto& matrix : {vintfObject->getDeviceCompatibilityMatrix(),
+                                   vintfObject->getFrameworkCompatibilityMatrix()}) {
+            ret.push_back(matrix == nullptr ? "" : gCompatibilityMatrixConverter(*matrix));
+        }
+        return ret;
+    }
+
+    TemporaryFile cacheFile;
+    TemporaryFile objectCacheFile;
+    bool useObjectCache = false;
+    // The runtime info of the last object built.
+    std::shared_ptr<MockRuntimeInfo> runtimeInfo;
+    // Stats returned by the file system. If empty, getStat is not supported.
+    std::map<std::string, FileStat> fileStats;
+};
+
+TEST_F(VintfObjectCompatibilityCacheTest, Hit) {
+    MockFileSystem* fileSystem;
+    std::string error;
+    auto first = build(systemMatrixXml1, &fileSystem);
+    ASSERT_EQ(COMPATIBLE, first->checkCompatibility(&error)) << error;
+
+    // Only verify the inputs; do not read them again to compute the result.
+    auto second = build(systemMatrixXml1, &fileSystem);
+    EXPECT_CALL(*fileSystem, fetch(_, _)).Times(AnyNumber());
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kSystemLegacyMatrix), _)).Times(1);
+    EXPECT_EQ(COMPATIBLE, second->checkCompatibility(&error)) << error;
+}
+
+// Test that a hit neither fetches the runtime info nor reads files whose stat is recorded.
+TEST_F(VintfObjectCompatibilityCacheTest, HitVerifiedByStat) {
+    MockFileSystem* fileSystem;
+    fileStats = {{kVendorLegacyManifest, {1, 1, 1}},
+                 {kSystemManifest, {2, 2, 2}},
+                 {kVendorLegacyMatrix, {3, 3, 3}},
+                 {kSystemLegacyMatrix, {4, 4, 4}}};
+    std::string error;
+    auto first = build(systemMatrixXml1, &fileSystem);
+    ASSERT_EQ(COMPATIBLE, first->checkCompatibility(&error)) << error;
+
+    auto second = build(systemMatrixXml1, &fileSystem);
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kVendorLegacyManifest), _)).Times(0);
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kSystemManifest), _)).Times(0);
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kVendorLegacyMatrix), _)).Times(0);
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kSystemLegacyMatrix), _)).Times(0);
+    EXPECT_CALL(*runtimeInfo, fetchAllInformation(_)).Times(0);
+    EXPECT_EQ(COMPATIBLE, second->checkCompatibility(&error)) << error;
+}
+
+TEST_F(VintfObjectCompatibilityCacheTest, RuntimeInfoChanged) {
+    MockFileSystem* fileSystem;
+    std::string error;
+    auto first = build(systemMatrixXml1, &fileSystem);
+    ASSERT_EQ(COMPATIBLE, first->checkCompatibility(&error)) << error;
+
+    auto second = build(systemMatrixXml1, &fileSystem);
+    runtimeInfo->setNextFetchKernelInfo(KernelVersion{3, 18, 32}, {{"CONFIG_64BIT", "y"}});
+    EXPECT_CALL(*runtimeInfo, fetchAllInformation(_)).Times(AtLeast(1));
+    EXPECT_EQ(COMPATIBLE, second->checkCompatibility(&error)) << error;
+}
+
+TEST_F(VintfObjectCompatibilityCacheTest, InputChanged) {
+    MockFileSystem* fileSystem;
+    std::string error;
+    auto first = build(systemMatrixXml1, &fileSystem);
+    ASSERT_EQ(COMPATIBLE, first->checkCompatibility(&error)) << error;
+
+    auto second = build(systemMatrixXml2, &fileSystem);
+    EXPECT_EQ(INCOMPATIBLE, second->checkCompatibility(&error));
+    std::string incompatibleError = error;
+
+    // The new result is cached too.
+    error.clear();
+    auto third = build(systemMatrixXml2, &fileSystem);
+    EXPECT_EQ(INCOMPATIBLE, third->checkCompatibility(&error));
+    EXPECT_EQ(incompatibleError, error);
+}
+
+// Test that results are memoized in memory until an object is fetched again.
+TEST_F(VintfObjectCompatibilityCacheTest, Memoized) {
+    MockFileSystem* fileSystem;
+    std::string error;
+    auto object = build(systemMatrixXml2, &fileSystem);
+    ASSERT_EQ(INCOMPATIBLE, object->checkCompatibility(&error));
+    std::string incompatibleError = error;
+
+    // Nothing is read, not even to verify the on-disk cache.
+    EXPECT_CALL(*fileSystem, fetch(_, _)).Times(0);
+    EXPECT_CALL(*fileSystem, listFiles(_, _, _)).Times(0);
+    EXPECT_EQ(INCOMPATIBLE, object->checkCompatibility(nullptr));
+    error.clear();
+    EXPECT_EQ(INCOMPATIBLE, object->checkCompatibility(&error));
+    EXPECT_EQ(incompatibleError, error);
+    ::testing::Mock::VerifyAndClearExpectations(fileSystem);
+
+    // After fetching again, the result is computed again (here, from the on-disk cache).
+    object->getDeviceHalManifest(true /* skipCache */);
+    EXPECT_CALL(*fileSystem, fetch(_, _)).Times(AnyNumber());
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kSystemLegacyMatrix), _)).Times(1);
+    error.clear();
+    EXPECT_EQ(INCOMPATIBLE, object->checkCompatibility(&error));
+    EXPECT_EQ(incompatibleError, error);
+}
+
+// Test that an incompatibility replaces the text already in error, like an uncached check,
+// whether the result is computed, memoized or read from the on-disk cache.
+TEST_F(VintfObjectCompatibilityCacheTest, ErrorReplaced) {
+    MockFileSystem* fileSystem;
+    auto object = build(systemMatrixXml2, &fileSystem);
+    std::string error = "stale";
+    ASSERT_EQ(INCOMPATIBLE, object->checkCompatibility(&error));
+    EXPECT_THAT(error, Not(HasSubstr("stale")));
+    EXPECT_THAT(error, StartsWith("Device manifest and framework compatibility matrix"));
+    std::string incompatibleError = error;
+
+    error = "stale";
+    EXPECT_EQ(INCOMPATIBLE, object->checkCompatibility(&error));
+    EXPECT_EQ(incompatibleError, error);
+
+    auto second = build(systemMatrixXml2, &fileSystem);
+    error = "stale";
+    EXPECT_EQ(INCOMPATIBLE, second->checkCompatibility(&error));
+    EXPECT_EQ(incompatibleError, error);
+}
+
+TEST_F(VintfObjectCompatibilityCacheTest, ObjectCacheHit) {
+    MockFileSystem* fileSystem;
+    useObjectCache = true;
+    fileStats = {{kVendorLegacyManifest, {1, 1, 1}},
+                 {kSystemManifest, {2, 2, 2}},
+                 {kVendorLegacyMatrix, {3, 3, 3}},
+                 {kSystemLegacyMatrix, {4, 4, 4}}};
+    auto first = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+    auto expected = getObjectsXml(first.get());
+    ASSERT_EQ(4u, expected.size());
+    for (const auto& xml : expected) ASSERT_NE("", xml);
+
+    // All objects are loaded from the cache, which is validated by stat only.
+    auto second = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+    EXPECT_CALL(*fileSystem, fetch(_, _)).Times(0);
+    EXPECT_CALL(*fileSystem, listFiles(_, _, _)).Times(0);
+    EXPECT_EQ(expected, getObjectsXml(second.get()));
+    std::string error;
+    EXPECT_EQ(COMPATIBLE, second->checkCompatibility(&error)) << error;
+}
+
+TEST_F(VintfObjectCompatibilityCacheTest, ObjectCacheStale) {
+    MockFileSystem* fileSystem;
+    useObjectCache = true;
+    fileStats = {{kVendorLegacyManifest, {1, 1, 1}}, {kSystemLegacyMatrix, {4, 4, 4}}};
+    auto first = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+    auto expected = getObjectsXml(first.get());
+
+    // The device manifest, and the objects stored after it, are fetched again.
+    fileStats[kVendorLegacyManifest].mtimeNs++;
+    auto second = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+    EXPECT_CALL(*fileSystem, fetch(_, _)).Times(AnyNumber());
+    EXPECT_CALL(*fileSystem, fetch(StrEq(kVendorLegacyManifest), _)).Times(1);
+    EXPECT_EQ(expected, getObjectsXml(second.get()));
+}
+
+// Test that objects storing entries at the same time do not drop each other's entries.
+TEST_F(VintfObjectCompatibilityCacheTest, ObjectCacheConcurrentStores) {
+    MockFileSystem* fileSystem;
+    useObjectCache = true;
+    fileStats = {{kVendorLegacyManifest, {1, 1, 1}}, {kVendorLegacyMatrix, {3, 3, 3}}};
+    for (size_t i = 0; i < 20; ++i) {
+        ASSERT_EQ(0, truncate(objectCacheFile.path, 0));
+        auto manifestObject = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+        auto matrixObject = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+        std::thread manifestThread([&] { manifestObject->getDeviceHalManifest(); });
+        std::thread matrixThread([&] { matrixObject->getDeviceCompatibilityMatrix(); });
+        manifestThread.join();
+        matrixThread.join();
+
+        auto object = build(systemMatrixXml1, &fileSystem, false /* useCache */);
+        EXPECT_CALL(*fileSystem, fetch(_, _)).Times(AnyNumber());
+        EXPECT_CALL(*fileSystem, fetch(StrEq(kVendorLegacyManifest), _)).Times(0);
+        EXPECT_CALL(*fileSystem, fetch(StrEq(kVendorLegacyMatrix), _)).Times(0);
+        EXPECT_NE(nullptr, object->getDeviceHalManifest());
+        EXPECT_NE(nullptr, object->getDeviceCompatibilityMatrix());
+    }
+}
+
+TEST_F(VintfObjectCompatibilityCacheTest, ConcurrentChecks) {
+    MockFileSystem* fileSystem;
+    for (const auto& systemMatrixXml : {systemMatrixXml1, systemMatrixXml2}) {
+        std::string sequentialError;
+        auto sequential = build(systemMatrixXml, &fileSystem, false /* useCache */);
+        int32_t sequentialStatus = sequential->checkCompatibility(&sequentialError);
+
+        std::string concurrentError;
+        auto concurrent = build(systemMatrixXml, &fileSystem, false /* useCache */,
+                                true /* concurrent */);
+        EXPECT_EQ(sequentialStatus, concurrent->checkCompatibility(&concurrentError));
+        EXPECT_EQ(sequentialError, concurrentError);
+    }
+}
+
+// Test that VintfObjects built with the same framework source read the framework side once.
+TEST(VintfObjectFrameworkSourceTest, CheckCompatibilityForAll) {
+    const std::string matrixPath = kSystemVintfDir + "compatibility_matrix.1.xml";
+    std::string matrixXml = systemMatrixXml1;
+    matrixXml.replace(matrixXml.find("type=\"framework\""), strlen("type=\"framework\""),
+                      "type=\"framework\" level=\"1\"");
+
+    auto frameworkFileSystem = std::make_unique<NiceMock<MockFileSystem>>();
+    ON_CALL(*frameworkFileSystem, listFiles(_, _, _)).WillByDefault(Return(NAME_NOT_FOUND));
+    ON_CALL(*frameworkFileSystem, fetch(_, _)).WillByDefault(Return(NAME_NOT_FOUND));
+    ON_CALL(*frameworkFileSystem, listFiles(StrEq(kSystemVintfDir), _, _))
+        .WillByDefault(Invoke([](const auto&, auto* out, auto*) {
+            *out = {"compatibility_matrix.1.xml"};
+            return ::android::OK;
+        }));
+    EXPECT_CALL(*frameworkFileSystem, fetch(_, _)).Times(AnyNumber());
+    for (const auto& [path, content] : std::map<std::string, std::string>{
+             {kSystemManifest, systemManifestXml1}, {matrixPath, matrixXml}}) {
+        EXPECT_CALL(*frameworkFileSystem, fetch(StrEq(path), _))
+            .Times(1)
+            .WillOnce(Invoke([content = content](const auto&, auto& out) {
+                out = content;
+                return ::android::OK;
+            }));
+    }
+    std::shared_ptr<VintfObject> framework =
+        VintfObject::Builder()
+            .setFileSystem(std::move(frameworkFileSystem))
+            .setPropertyFetcher(std::make_unique<NiceMock<MockPropertyFetcher>>())
+            .build();
+
+    std::vector<std::unique_ptr<VintfObject>> devices;
+    for (const auto& vendorManifestXml : {vendorManifestXml1, vendorManifestXml2}) {
+        auto fileSystem = std::make_unique<NiceMock<MockFileSystem>>();
+        ON_CALL(*fileSystem, listFiles(_, _, _)).WillByDefault(Return(NAME_NOT_FOUND));
+        ON_CALL(*fileSystem, fetch(_, _)).WillByDefault(Return(NAME_NOT_FOUND));
+        for (const auto& [path, content] : std::map<std::string, std::string>{
+                 {kVendorLegacyManifest, vendorManifestXml},
+                 {kVendorLegacyMatrix, vendorMatrixXml1}}) {
+            ON_CALL(*fileSystem, fetch(StrEq(path), _))
+                .WillByDefault(Invoke([content = content](const auto&, auto& out) {
+                    out = content;
+                    return ::android::OK;
+                }));
+        }
+        EXPECT_CALL(*fileSystem, fetch(_, _)).Times(AnyNumber());
+        EXPECT_CALL(*fileSystem, fetch(StrEq(kSystemManifest), _)).Times(0);
+        EXPECT_CALL(*fileSystem, fetch(StrEq(matrixPath), _)).Times(0);
+        devices.push_back(VintfObject::Builder()
+                              .setFileSystem(std::move(fileSystem))
+                              .setPropertyFetcher(std::make_unique<NiceMock<MockPropertyFetcher>>())
+                              .setFrameworkSource(framework)
+                              .build());
+    }
+
+    std::vector<VintfObject*> objects{devices[0].get(), devices[1].get()};
+    auto results = VintfObject::CheckCompatibilityForAll(objects, 2 /* numThreads */,
+                                                         CheckFlags::DEFAULT.disableRuntimeInfo());
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ(COMPATIBLE, results[0].first) << results[0].second;
+    EXPECT_EQ(INCOMPATIBLE, results[1].first);
+    EXPECT_IN("android.hardware.camera", results[1].second);
+
+    // Same result as checking one by one.
+    for (size_t i = 0; i < objects.size(); ++i) {
+        std::string error;
+        EXPECT_EQ(results[i].first,
+                  objects[i]->checkCompatibility(&error, CheckFlags::DEFAULT.disableRuntimeInfo()));
+        EXPECT_EQ(results[i].second, error);
+    }
+}
+
+// Test that recheckCompatibility only reads the changed fragment.
+class VintfObjectIncrementalTest : public VintfObjectTestBase {
+   protected:
+    virtual void SetUp() {
+        vintfObject = VintfObject::Builder()
+                          .setFileSystem(std::make_unique<NiceMock<MockFileSystem>>())
+                          .setRuntimeInfoFactory(std::make_unique<NiceMock<MockRuntimeInfoFactory>>(
+                              std::make_shared<NiceMock<MockRuntimeInfo>>()))
+                          .setPropertyFetcher(std::make_unique<NiceMock<MockPropertyFetcher>>())
+                          .setIncrementalChecks(true)
+                          .build();
+        useEmptyFileSystem();
+        expectFetchRepeatedly(kVendorManifest, vendorManifest);
+        expectFetchRepeatedly(kSystemManifest, systemManifestXml1);
+        expectFetchRepeatedly(kSystemLegacyMatrix, systemMatrixXml1);
+        expectFetchRepeatedly(kVendorLegacyMatrix, vendorMatrixXml1);
+        EXPECT_CALL(fetcher(), listFiles(StrEq(kVendorManifestFragmentDir), _, _))
+            .WillOnce(Invoke([](const auto&, auto* out, auto*) {
+                *out = {"camera.xml"};
+                return ::android::OK;
+            }));
+        EXPECT_CALL(fetcher(), fetch(StrEq(kVendorManifestFragmentDir + "camera.xml"), _))
+            .Times(AnyNumber())
+            .WillRepeatedly(Invoke([this](const auto&, auto& out) {
+                out = cameraFragment;
+                return ::android::OK;
+            }));
+    }
+
+    // Expect that only the fragment is read again.
+    void expectOnlyFragment() {
+        expectNeverFetch(kVendorManifest);
+        expectNeverFetch(kSystemManifest);
+        expectNeverFetch(kSystemLegacyMatrix);
+        expectNeverFetch(kVendorLegacyMatrix);
+    }
+
+    static std::string camera(const std::string& version) {
+        return "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+               "    <hal format=\"hidl\">\n"
+               "        <name>android.hardware.camera</name>\n"
+               "        <transport>hwbinder</transport>\n"
+               "        <fqname>@" + version + "::ICamera/default</fqname>\n"
+               "    </hal>\n"
+               "</manifest>\n";
+    }
+
+    const std::string vendorManifest =
+        "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+        "    <hal format=\"hidl\">\n"
+        "        <name>android.hardware.nfc</name>\n"
+        "        <transport>hwbinder</transport>\n"
+        "        <fqname>@1.0::INfc/default</fqname>\n"
+        "    </hal>\n"
+        "    <sepolicy>\n"
+        "        <version>25.5</version>\n"
+        "    </sepolicy>\n"
+        "</manifest>\n";
+    std::string cameraFragment = camera("3.5");
+};
+
+TEST_F(VintfObjectIncrementalTest, ChangeFragment) {
+    const std::string path = kVendorManifestFragmentDir + "camera.xml";
+    std::string error;
+    ASSERT_EQ(COMPATIBLE, vintfObject->checkCompatibility(&error)) << error;
+
+    expectOnlyFragment();
+    cameraFragment = camera("1.0");
+    EXPECT_EQ(INCOMPATIBLE, vintfObject->recheckCompatibility(path, &error));
+    EXPECT_IN(
+        "android.hardware.camera:\n"
+        "    required: \n",
+        error);
+    EXPECT_IN("    provided: @1.0::ICamera/default", error);
+    EXPECT_FALSE(vintfObject->getDeviceHalManifest()->hasHidlInstance(
+        "android.hardware.camera", {3, 5}, "ICamera", "default"));
+
+    error.clear();
+    cameraFragment = camera("3.5");
+    EXPECT_EQ(COMPATIBLE, vintfObject->recheckCompatibility(path, &error)) << error;
+    EXPECT_FALSE(vintfObject->getDeviceHalManifest()->hasHidlInstance(
+        "android.hardware.camera", {1, 0}, "ICamera", "default"));
+    EXPECT_TRUE(vintfObject->getDeviceHalManifest()->hasHidlInstance(
+        "android.hardware.nfc", {1, 0}, "INfc", "default"));
+}
+
+TEST_F(VintfObjectIncrementalTest, DeleteFragment) {
+    const std::string path = kVendorManifestFragmentDir + "camera.xml";
+    std::string error;
+    ASSERT_EQ(COMPATIBLE, vintfObject->checkCompatibility(&error)) << error;
+
+    expectOnlyFragment();
+    EXPECT_CALL(fetcher(), fetch(StrEq(path), _))
+        .WillRepeatedly(Return(::android::NAME_NOT_FOUND));
+    EXPECT_EQ(INCOMPATIBLE, vintfObject->recheckCompatibility(path, &error));
+    EXPECT_IN("android.hardware.camera:", error);
+    EXPECT_EQ(std::set<std::string>{"android.hardware.nfc"},
+              vintfObject->getDeviceHalManifest()->getHalNames());
+}
+
 const std::string vendorManifestKernelFcm =
         "<manifest " + kMetaVersionStr + " type=\"device\">\n"
         "    <kernel version=\"3.18.999\" target-level=\"92\"/>\n"
@@ -853,6 +1300,83 @@ TEST_P(OdmManifestTest, OdmLegacyManifest) {
 
 INSTANTIATE_TEST_SUITE_P(OdmManifest, OdmManifestTest, ::testing::Values("", "fake_sku"));
 
+// Test that manifest fragments are merged in the order of listFiles, whether they are
+// fetched on worker threads or not.
+class ManifestFragmentsTest : public VintfObjectTestBase,
+                              public ::testing::WithParamInterface<bool> {
+   protected:
+    virtual void SetUp() override {
+        vintfObject = VintfObject::Builder()
+                          .setFileSystem(std::make_unique<NiceMock<MockFileSystem>>())
+                          .setRuntimeInfoFactory(std::make_unique<NiceMock<MockRuntimeInfoFactory>>(
+                              std::make_shared<NiceMock<MockRuntimeInfo>>()))
+                          .setPropertyFetcher(std::make_unique<NiceMock<MockPropertyFetcher>>())
+                          .setConcurrentChecks(GetParam())
+                          .build();
+        useEmptyFileSystem();
+        expectFetchRepeatedly(kVendorManifest,
+                              "<manifest " + kMetaVersionStr +
+                                  " type=\"device\" target-level=\"2\"/>");
+        for (size_t i = 0; i < kNumFragments; ++i) {
+            fileNames.push_back("foo" + std::to_string(i) + ".xml");
+            expectFetchRepeatedly(kVendorManifestFragmentDir + fileNames.back(),
+                                  foo(i, "default", false /* override */));
+        }
+        EXPECT_CALL(fetcher(), listFiles(StrEq(kVendorManifestFragmentDir), _, _))
+            .WillRepeatedly(Invoke([this](const auto&, auto* out, auto*) {
+                *out = fileNames;
+                return ::android::OK;
+            }));
+    }
+
+    static std::string foo(size_t i, const std::string& instance, bool override) {
+        return "<manifest " + kMetaVersionStr + " type=\"device\">\n"
+               "    <hal format=\"hidl\"" + (override ? " override=\"true\"" : "") + ">\n"
+               "        <name>android.hardware.foo" + std::to_string(i) + "</name>\n"
+               "        <transport>hwbinder</transport>\n"
+               "        <version>1.0</version>\n"
+               "        <interface>\n"
+               "            <name>IFoo</name>\n"
+               "            <instance>" + instance + "</instance>\n"
+               "        </interface>\n"
+               "    </hal>\n"
+               "</manifest>\n";
+    }
+
+    static constexpr size_t kNumFragments = 16;
+    std::vector<std::string> fileNames;
+};
+
+TEST_P(ManifestFragmentsTest, Override) {
+    // Overrides the HAL in the first fragment, so it must be merged after it.
+    fileNames.push_back("override.xml");
+    expectFetchRepeatedly(kVendorManifestFragmentDir + "override.xml",
+                          foo(0, "other", true /* override */));
+
+    HalManifest manifest;
+    std::string error;
+    ASSERT_EQ(OK, fetchDeviceHalManifest(&manifest, &error)) << error;
+    EXPECT_FALSE(manifest.hasHidlInstance("android.hardware.foo0", {1, 0}, "IFoo", "default"));
+    EXPECT_TRUE(manifest.hasHidlInstance("android.hardware.foo0", {1, 0}, "IFoo", "other"));
+    for (size_t i = 1; i < kNumFragments; ++i) {
+        EXPECT_TRUE(manifest.hasHidlInstance("android.hardware.foo" + std::to_string(i),
+                                             {1, 0}, "IFoo", "default"));
+    }
+}
+
+TEST_P(ManifestFragmentsTest, FirstErrorReported) {
+    expectFetchRepeatedly(kVendorManifestFragmentDir + fileNames[3], "<manifest");
+    expectFetchRepeatedly(kVendorManifestFragmentDir + fileNames[7], "<manifest");
+
+    HalManifest manifest;
+    std::string error;
+    EXPECT_NE(OK, fetchDeviceHalManifest(&manifest, &error));
+    EXPECT_IN(fileNames[3], error);
+    EXPECT_EQ(std::string::npos, error.find(fileNames[7])) << error;
+}
+
+INSTANTIATE_TEST_SUITE_P(ManifestFragments, ManifestFragmentsTest, ::testing::Bool());
+
 struct CheckedFqInstance : FqInstance {
     CheckedFqInstance(const char* s) : CheckedFqInstance(std::string(s)) {}
     CheckedFqInstance(const std::string& s) { CHECK(setTo(s)) << s; }
@@ -991,6 +1515,9 @@ TEST_F(DeprecateTest, HidlMetadataNotDeprecate) {
     };
     EXPECT_EQ(NO_DEPRECATED_HALS, vintfObject->checkDeprecation(pred, hidlMetadata, &error))
         << "major@1.0 should not be deprecated because it extends from 2.0: " << error;
+    HidlInheritanceGraph inheritance(hidlMetadata);
+    EXPECT_EQ(NO_DEPRECATED_HALS, vintfObject->checkDeprecation(pred, inheritance, &error))
+        << "major@1.0 should not be deprecated because it extends from 2.0: " << error;
 }
 
 TEST_F(DeprecateTest, HidlMetadataDeprecate) {
@@ -1007,6 +1534,67 @@ TEST_F(DeprecateTest, HidlMetadataDeprecate) {
         << "major@1.0 should be deprecated. " << error;
 }
 
+TEST_F(DeprecateTest, ListInstancesMemoized) {
+    auto pred = getInstanceListFunc({
+        "android.hardware.minor@1.0::IMinor/default",
+        "android.hardware.major@1.0::IMajor/default",
+    });
+    std::map<std::string, size_t> calls;
+    auto countingPred = [&](const std::string& package, Version version,
+                            const std::string& interface, const auto& hintInstances) {
+        ++calls[toFQNameString(package, version, interface) + "/" +
+                android::base::Join(hintInstances, ",")];
+        return pred(package, version, interface, hintInstances);
+    };
+
+    std::string error;
+    EXPECT_EQ(DEPRECATED, vintfObject->checkDeprecation(countingPred, {}, &error));
+    ASSERT_FALSE(calls.empty());
+    for (const auto& [query, count] : calls) {
+        EXPECT_EQ(1u, count) << query << " is listed more than once";
+    }
+
+    // Same result as without memoization.
+    std::string memoizedError;
+    EXPECT_EQ(DEPRECATED, vintfObject->checkDeprecation(
+                              VintfObject::MemoizeListInstances(pred), {}, &memoizedError));
+    EXPECT_EQ(error, memoizedError);
+}
+
+TEST_F(DeprecateTest, ThreadSafeListInstances) {
+    auto pred = getInstanceListFunc({
+        "android.hardware.minor@1.0::IMinor/default",
+        "android.hardware.minor@1.0::IMinor/legacy",
+        "android.hardware.major@1.0::IMajor/default",
+    });
+    HidlInheritanceGraph inheritance({});
+    std::string sequentialError;
+    EXPECT_EQ(DEPRECATED, vintfObject->checkDeprecation(pred, inheritance, &sequentialError));
+    std::string concurrentError;
+    EXPECT_EQ(DEPRECATED, vintfObject->checkDeprecation(pred, inheritance, &concurrentError,
+                                                        true /* listInstancesIsThreadSafe */));
+    EXPECT_EQ(sequentialError, concurrentError);
+    EXPECT_IN("android.hardware.minor", concurrentError);
+    EXPECT_IN("android.hardware.major", concurrentError);
+}
+
+TEST_F(DeprecateTest, MatrixFragmentsFetchedOnce) {
+    expectFetch(kSystemVintfDir + "compatibility_matrix.1.xml", systemMatrixLevel1);
+    expectFetch(kSystemVintfDir + "compatibility_matrix.2.xml", systemMatrixLevel2);
+
+    auto pred = getInstanceListFunc({
+        "android.hardware.minor@1.1::IMinor/default",
+        "android.hardware.major@2.0::IMajor/default",
+    });
+    std::string error;
+    EXPECT_EQ(NO_DEPRECATED_HALS, vintfObject->checkDeprecation(pred, {}, &error)) << error;
+    EXPECT_EQ(NO_DEPRECATED_HALS, vintfObject->checkDeprecation(pred, {}, &error)) << error;
+    EXPECT_NE(nullptr, vintfObject->getFrameworkCompatibilityMatrix());
+    auto hasExtensions = vintfObject->hasFrameworkCompatibilityMatrixExtensions();
+    ASSERT_TRUE(hasExtensions.ok()) << hasExtensions.error();
+    EXPECT_FALSE(*hasExtensions);
+}
+
 class MultiMatrixTest : public VintfObjectTestBase {
    protected:
     void SetUp() override {
@@ -17,8 +17,13 @@
 #ifndef ANDROID_VINTF_UTILS_H
 #define ANDROID_VINTF_UTILS_H
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include <utils/Errors.h>
 #include <vintf/FileSystem.h>
@@ -100,6 +105,20 @@ static bool mergeField(T* dst, T* src, const T& empty = T{}) {
     return false;
 }
 
+// Call func(i) for each i in [0, count) on up to numThreads threads, including the calling
+// thread. Each index is processed exactly once, in no particular order.
+inline void parallelFor(size_t count, size_t numThreads, const std::function<void(size_t)>& func) {
+    numThreads = std::max<size_t>(1, std::min(numThreads, count));
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) func(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+}
+
 }  // namespace details
 }  // namespace vintf
 }  // namespace android